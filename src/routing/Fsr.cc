@@ -4,10 +4,12 @@
  */
 
 #include "inet/routing/fsr/Fsr.h"
+#include "inet/routing/fsr/FsrPacketSerializer.h"
 #include "inet/common/ModuleAccess.h"
 #include "inet/common/ProtocolTag_m.h"
 #include "inet/common/lifecycle/ModuleOperations.h"
 #include "inet/networklayer/common/L3AddressTag_m.h"
+#include "inet/networklayer/common/NextHopAddressTag_m.h"
 #include "inet/networklayer/ipv4/Ipv4Header_m.h"
 #include "inet/networklayer/ipv4/Ipv4RoutingTable.h"
 #include "inet/transportlayer/common/L4PortTag_m.h"
@@ -15,42 +17,107 @@
 #include "inet/transportlayer/udp/UdpHeader_m.h"
 #include "inet/common/packet/chunk/ByteCountChunk.h"
 #include "inet/common/packet/chunk/BytesChunk.h"
+#include "inet/linklayer/common/InterfaceTag_m.h"
+
+#include <algorithm>
+#include <cmath>
 
 namespace inet {
 namespace fsr {
 
 Define_Module(Fsr);
 
+simsignal_t Fsr::helloSentSignal = registerSignal("helloSent");
+simsignal_t Fsr::lspSentSignal = registerSignal("lspSent");
+simsignal_t Fsr::lspRequestSentSignal = registerSignal("lspRequestSent");
+simsignal_t Fsr::controlSentSignal = registerSignal("controlSent");
+simsignal_t Fsr::helloReceivedSignal = registerSignal("helloReceived");
+simsignal_t Fsr::lspReceivedSignal = registerSignal("lspReceived");
+simsignal_t Fsr::lspDuplicateSignal = registerSignal("lspDuplicate");
+simsignal_t Fsr::lspRelayedSignal = registerSignal("lspRelayed");
+simsignal_t Fsr::relaySuppressedSignal = registerSignal("relaySuppressed");
+simsignal_t Fsr::spfRunSignal = registerSignal("spfRun");
+simsignal_t Fsr::spfAvoidedSignal = registerSignal("spfAvoided");
+simsignal_t Fsr::routesAddedSignal = registerSignal("routesAdded");
+simsignal_t Fsr::routesChangedSignal = registerSignal("routesChanged");
+simsignal_t Fsr::routesDeletedSignal = registerSignal("routesDeleted");
+simsignal_t Fsr::topologySizeSignal = registerSignal("topologySize");
+simsignal_t Fsr::neighborCountSignal = registerSignal("neighborCount");
+simsignal_t Fsr::helloIntervalSignal = registerSignal("helloInterval");
+simsignal_t Fsr::lspIntervalSignal = registerSignal("lspInterval");
+simsignal_t Fsr::loadLevelSignal = registerSignal("loadLevel");
+
+// Trace point stamped with the current simulation time; compiled out with FSR_NO_TRACE
+#define FSR_TRACE_EVENT(category, event, a, b, c) FSR_TRACE(trace, simTime().dbl(), category, event, a, b, c)
+
 Fsr::Fsr()
 {
     helloBroadcastTimer = nullptr;
     lspUpdateTimer = nullptr;
-    decrementAgeTimer = nullptr;
-    lspLifeTimeTimer = nullptr;
+    topologyExpiryTimer = nullptr;
     testTimer = nullptr;
+    neighborExpiryTimer = nullptr;
+    lspAggregationTimer = nullptr;
+    spfTimer = nullptr;
     routingTable = nullptr;
     interfaceTable = nullptr;
+    routeInterface = nullptr;
+    incrementalRouteUpdate = true;
+    incrementalSpf = true;
+    fisheyeScoping = true;
+    lspFloodHopCount = 10;
+    maxLspPacketSize = 1400;
+    deltaLsp = true;
+    lspFullRefreshInterval = 60;
+    lspAggregationWindow = 0;
+    helloLinkState = false;
+    relaySuppression = RELAY_ALWAYS;
+    relayCounterThreshold = 3;
+    relayJitter = 0.01;
+    adaptiveIntervals = false;
+    helloIntervalMin = helloIntervalMax = 0;
+    lspIntervalMin = lspIntervalMax = 0;
+    intervalChurnThreshold = 1;
+    routingMetric = METRIC_HOP_COUNT;
+    etxWindow = 10;
+    etxChangeThreshold = 0.2;
+    multipath = false;
+    maxMultipathNextHops = 4;
+    loadAwareRouting = false;
+    loadSampleInterval = 1;
+    loadQueueLength = 100;
+    loadDropRate = 10;
+    loadSmoothing = 0.3;
+    loadLevels = 4;
+    loadHysteresis = 0.05;
+    loadPenalty = 2;
     sequenceNumber = 0;
+    helloSequenceNumber = 0;
     controlBytesSent = 0;
     numLSPsSent = 0;
     numLSPsReceived = 0;
     numHellosSent = 0;
     numPacketsReceived = 0;
+    numRelaysSent = 0;
+    numRelaysSuppressed = 0;
+    numSpfRuns = 0;
+    numSpfAvoided = 0;
+    numMultipathSteered = 0;
 }
 
 Fsr::~Fsr()
 {
     cancelAndDelete(helloBroadcastTimer);
     cancelAndDelete(lspUpdateTimer);
-    cancelAndDelete(decrementAgeTimer);
-    cancelAndDelete(lspLifeTimeTimer);
+    cancelAndDelete(topologyExpiryTimer);
     cancelAndDelete(testTimer);
-
-    // Cancel neighbor timeout timers
-    for (auto &entry : neighborTimeouts) {
-        cancelAndDelete(entry.second);
-    }
-    neighborTimeouts.clear();
+    cancelAndDelete(neighborExpiryTimer);
+    cancelAndDelete(lspAggregationTimer);
+    cancelAndDelete(spfTimer);
+    cancelAndDelete(loadSampleTimer);
+    for (auto timer : scopeTimers)
+        cancelAndDelete(timer);
+    scopeTimers.clear();
 }
 
 void Fsr::initialize(int stage)
@@ -62,10 +129,109 @@ void Fsr::initialize(int stage)
         // Read parameters
         helloBroadcastInterval = par("helloBroadcastInterval");
         lspUpdateInterval = par("lspUpdateInterval");
-        maxWaitTimeForLspAnnouncement = par("maxWaitTimeForLspAnnouncement");
         maxJitter = par("maxJitter");
-        lspLifeTimeInterval = par("lspLifeTimeInterval");
         lifeTime = par("lifeTime");
+        if (lifeTime <= 0)
+            throw cRuntimeError("lifeTime must be positive");
+        neighborHoldTime = 3 * helloBroadcastInterval;
+        incrementalRouteUpdate = par("incrementalRouteUpdate");
+        incrementalSpf = par("incrementalSpf");
+        linkState.setTrackChanges(incrementalSpf && incrementalRouteUpdate);
+        fisheyeScoping = par("fisheyeScoping");
+        lspFloodHopCount = par("lspFloodHopCount");
+        maxLspPacketSize = par("maxLspPacketSize");
+        deltaLsp = par("deltaLsp");
+        lspFullRefreshInterval = par("lspFullRefreshInterval");
+        lspAggregationWindow = par("lspAggregationWindow");
+        helloLinkState = par("helloLinkState");
+        spreadLsps = par("spreadLsps");
+        std::string suppression = par("relaySuppression").stdstringValue();
+        if (suppression == "none")
+            relaySuppression = RELAY_ALWAYS;
+        else if (suppression == "counter")
+            relaySuppression = RELAY_COUNTER;
+        else if (suppression == "mpr")
+            relaySuppression = RELAY_MPR;
+        else
+            throw cRuntimeError("Unknown relaySuppression '%s', expected none, counter or mpr", suppression.c_str());
+        relayCounterThreshold = par("relayCounterThreshold");
+        relayJitter = par("relayJitter");
+        spfInitialDelay = par("spfInitialDelay").doubleValue();
+        spfHoldTime = par("spfHoldTime").doubleValue();
+        spfMaxHoldTime = par("spfMaxHoldTime").doubleValue();
+        if (spfMaxHoldTime < spfHoldTime)
+            throw cRuntimeError("spfMaxHoldTime must not be smaller than spfHoldTime");
+        spfCurrentHold = spfHoldTime;
+        adaptiveIntervals = par("adaptiveIntervals");
+        helloIntervalMin = par("helloIntervalMin");
+        helloIntervalMax = par("helloIntervalMax");
+        lspIntervalMin = par("lspIntervalMin");
+        lspIntervalMax = par("lspIntervalMax");
+        intervalChurnThreshold = par("intervalChurnThreshold");
+        if (adaptiveIntervals) {
+            // Jitter is added to every interval, it must not make one negative
+            if (helloIntervalMin <= maxJitter || helloIntervalMax < helloIntervalMin)
+                throw cRuntimeError("Need maxJitter < helloIntervalMin <= helloIntervalMax");
+            if (lspIntervalMin <= maxJitter || lspIntervalMax < lspIntervalMin)
+                throw cRuntimeError("Need maxJitter < lspIntervalMin <= lspIntervalMax");
+            if (intervalChurnThreshold < 1)
+                throw cRuntimeError("intervalChurnThreshold must be at least 1");
+        }
+        std::string metric = par("routingMetric").stdstringValue();
+        if (metric == "hopCount")
+            routingMetric = METRIC_HOP_COUNT;
+        else if (metric == "etx")
+            routingMetric = METRIC_ETX;
+        else
+            throw cRuntimeError("Unknown routingMetric '%s', expected hopCount or etx", metric.c_str());
+        etxWindow = par("etxWindow");
+        etxChangeThreshold = par("etxChangeThreshold");
+        if (etxWindow < 1 || etxChangeThreshold < 0)
+            throw cRuntimeError("Need etxWindow >= 1 and etxChangeThreshold >= 0");
+        multipath = par("multipath");
+        maxMultipathNextHops = par("maxMultipathNextHops");
+        if (maxMultipathNextHops < 1)
+            throw cRuntimeError("maxMultipathNextHops must be at least 1");
+        loadAwareRouting = par("loadAwareRouting");
+        loadSampleInterval = par("loadSampleInterval");
+        loadQueueLength = par("loadQueueLength");
+        loadDropRate = par("loadDropRate");
+        loadSmoothing = par("loadSmoothing");
+        loadLevels = par("loadLevels");
+        loadHysteresis = par("loadHysteresis");
+        loadPenalty = par("loadPenalty");
+        if (loadAwareRouting) {
+            if (loadSampleInterval <= 0 || loadQueueLength < 1 || loadDropRate <= 0)
+                throw cRuntimeError("Need loadSampleInterval > 0, loadQueueLength >= 1 and loadDropRate > 0");
+            if (loadSmoothing <= 0 || loadSmoothing > 1)
+                throw cRuntimeError("loadSmoothing must be in (0, 1]");
+            // The top level must stay reachable with a saturated average
+            if (loadLevels < 2 || loadHysteresis < 0 || loadHysteresis >= 1.0 / loadLevels)
+                throw cRuntimeError("Need loadLevels >= 2 and 0 <= loadHysteresis < 1 / loadLevels");
+            if (loadPenalty < 0 || loadPenalty * FsrTopologyTable::UNIT_COST > 65535)
+                throw cRuntimeError("loadPenalty must be in [0, 655]");
+        }
+        // Load penalties need link costs; with hop count every link then costs UNIT_COST
+        linkState.setWeighted(routingMetric == METRIC_ETX || loadAwareRouting);
+        linkState.setLoadPenalty(loadAwareRouting ? (uint32_t)std::round(loadPenalty * FsrTopologyTable::UNIT_COST) : 0);
+
+        // Scope i covers hop distances (radius[i-1], radius[i]], the last scope everything farther
+        scopeRadii.clear();
+        for (int radius : cStringTokenizer(par("scopeRadii").stringValue()).asIntVector()) {
+            if (radius <= 0 || (!scopeRadii.empty() && (uint32_t)radius <= scopeRadii.back()))
+                throw cRuntimeError("scopeRadii must be positive and strictly increasing");
+            scopeRadii.push_back(radius);
+        }
+        scopeIntervalFactors = cStringTokenizer(par("scopeIntervalFactors").stringValue()).asDoubleVector();
+        if (scopeIntervalFactors.size() != scopeRadii.size() + 1)
+            throw cRuntimeError("scopeIntervalFactors needs one entry more than scopeRadii (got %d and %d)",
+                    (int)scopeIntervalFactors.size(), (int)scopeRadii.size());
+        scopeIntervals.resize(scopeIntervalFactors.size());
+        setLspInterval(lspUpdateInterval);
+        double outermostInterval = scopeIntervalFactors.back() * (adaptiveIntervals ? lspIntervalMax : lspUpdateInterval);
+        if (fisheyeScoping && outermostInterval >= lifeTime)
+            EV_WARN << "Outermost scope interval " << outermostInterval << "s is not below lifeTime "
+                    << lifeTime << "s, far entries will expire between updates" << endl;
 
         if (hasPar("fsrPort")) {
             fsrPort = par("fsrPort");
@@ -74,6 +240,16 @@ void Fsr::initialize(int stage)
             fsrPort = 6543; // Default port
         }
 
+        uint32_t traceMask;
+        std::string unknownCategory;
+        if (!FsrTraceBuffer::parseCategories(par("traceCategories").stringValue(), traceMask, unknownCategory))
+            throw cRuntimeError("Unknown trace category '%s' in traceCategories", unknownCategory.c_str());
+        int traceBufferSize = par("traceBufferSize");
+        if (traceBufferSize < 0)
+            throw cRuntimeError("traceBufferSize must not be negative");
+        trace.configure(traceMask, traceBufferSize);
+        traceFile = par("traceFile").stdstringValue();
+
         EV_INFO << "Node: " << getContainingNode(this)->getFullName() << " | FSR Parameters:" << endl;
         EV_INFO << "  helloBroadcastInterval: " << helloBroadcastInterval << "s" << endl;
         EV_INFO << "  lspUpdateInterval: " << lspUpdateInterval << "s" << endl;
@@ -82,9 +258,14 @@ void Fsr::initialize(int stage)
         // Initialize timers (create them, don't schedule yet)
         helloBroadcastTimer = new cMessage("helloBroadcastTimer");
         lspUpdateTimer = new cMessage("lspUpdateTimer");
-        decrementAgeTimer = new cMessage("decrementAgeTimer");
-        lspLifeTimeTimer = new cMessage("lspLifeTimeTimer");
+        topologyExpiryTimer = new cMessage("topologyExpiryTimer");
         testTimer = new cMessage("testTimer"); // If you still have this for debugging
+        neighborExpiryTimer = new cMessage("neighborExpiryTimer");
+        lspAggregationTimer = new cMessage("lspAggregationTimer");
+        spfTimer = new cMessage("spfTimer");
+        loadSampleTimer = new cMessage("loadSampleTimer");
+        for (size_t i = 0; i < scopeIntervals.size(); i++)
+            scopeTimers.push_back(new cMessage("scopeUpdateTimer", (short)i));
 
         // Initialize statistics
         WATCH(numLSPsSent);
@@ -92,6 +273,11 @@ void Fsr::initialize(int stage)
         WATCH(numHellosSent);
         WATCH(numPacketsReceived);
         WATCH(controlBytesSent);
+        WATCH(numRelaysSent);
+        WATCH(numRelaysSuppressed);
+        WATCH(numSpfRuns);
+        WATCH(numSpfAvoided);
+        WATCH(numMultipathSteered);
 
         socketInitialized = false; // Ensure flag is reset at the beginning
     }
@@ -113,6 +299,11 @@ void Fsr::initialize(int stage)
                 cModule *rtModule = ipv4Module->getSubmodule("routingTable");
                 if (!rtModule) throw cRuntimeError("RoutingTable module not found in IPv4 module");
                 routingTable = check_and_cast<IRoutingTable*>(rtModule);
+                batchRoutingTable = dynamic_cast<FsrRoutingTable*>(rtModule);
+                // The table also deletes routes by itself, e.g. those of a removed or reconfigured interface
+                rtModule->subscribe(routeDeletedSignal, this);
+                if (multipath)
+                    networkProtocol = check_and_cast<INetfilter*>(ipv4Module->getSubmodule("ip"));
                 // To get full path, cast to cModule*
                 EV_INFO << "Routing table module acquired: " << (dynamic_cast<cModule*>(routingTable) ? dynamic_cast<cModule*>(routingTable)->getFullPath().c_str() : "N/A") << endl;
 
@@ -129,6 +320,11 @@ void Fsr::initialize(int stage)
 
             if (!routingTable) throw cRuntimeError("RoutingTable pointer is null after attempting to acquire");
             if (!interfaceTable) throw cRuntimeError("InterfaceTable pointer is null after attempting to acquire");
+            resolveInterfaces();
+            if (loadAwareRouting)
+                resolveLoadSources();
+            if (networkProtocol)
+                networkProtocol->registerHook(0, this);
 
             selfAddress = getRouterId(); // Helper function to get node's IP
             EV_INFO << "Self IP Address determined: " << selfAddress << endl;
@@ -137,9 +333,8 @@ void Fsr::initialize(int stage)
                 EV_ERROR << "CRITICAL: Could not determine node IP address! FSR may not function correctly." << endl;
             }
 
-            // Determine primary broadcast address and output interface ID
+            // Determine primary broadcast address
             primaryBroadcastAddress = Ipv4Address::ALLONES_ADDRESS; // Default
-            outputInterfaceId = -1; // Default
             bool broadcastAddrFound = false;
 
             if (!selfAddress.isUnspecified() && interfaceTable) {
@@ -160,9 +355,8 @@ void Fsr::initialize(int stage)
 
                             if (interfaceIp == selfAddress || !broadcastAddrFound) {
                                 primaryBroadcastAddress = calculatedBroadcastAddr;
-                                outputInterfaceId = ie->getInterfaceId();
                                 EV_INFO << "Selected broadcast address: " << primaryBroadcastAddress
-                                          << " from interface " << ie->getInterfaceName() << " (ID: " << outputInterfaceId << ")" << endl;
+                                          << " from interface " << ie->getInterfaceName() << " (ID: " << ie->getInterfaceId() << ")" << endl;
                                 broadcastAddrFound = true;
                                 if (interfaceIp == selfAddress) {
                                     break; // Prefer the interface matching selfAddress
@@ -190,8 +384,8 @@ void Fsr::initialize(int stage)
             EV_INFO << "Called UDP socket.setBroadcast(true) to enable broadcasting." << endl;
 
 
-            // Bind the socket
-            if (!selfAddress.isUnspecified()) {
+            // Bind the socket; with several interfaces the source address must follow the outgoing interface
+            if (!selfAddress.isUnspecified() && fsrInterfaces.size() <= 1) {
                 socket.bind(selfAddress, fsrPort);
                 EV_INFO << "FSR UDP socket bound to " << selfAddress << ":" << fsrPort << endl;
             } else {
@@ -218,6 +412,10 @@ void Fsr::initialize(int stage)
         }
 
         initNode(); // Initialize this node's entry in its own topology table
+        // handleStartOperation() returns early at boot (no routing table yet), so per-run state is sized here too
+        nextFullRefresh.assign(scopeIntervals.size(), SIMTIME_ZERO);
+        lspRequestHoldoff.assign(topologyTable.getNumIds(), SIMTIME_ZERO);
+        resetIntervals();
 
         logUdpActivity();
         logInterfaceInfo();
@@ -227,13 +425,15 @@ void Fsr::initialize(int stage)
         scheduleAt(simTime() + uniform(0, maxJitter), helloBroadcastTimer);
 
         if (lspUpdateTimer->isScheduled()) cancelEvent(lspUpdateTimer);
-        scheduleAt(simTime() + lspUpdateInterval + uniform(0, maxJitter), lspUpdateTimer);
-
-        if (decrementAgeTimer->isScheduled()) cancelEvent(decrementAgeTimer);
-        scheduleAt(simTime() + 1.0, decrementAgeTimer);
-
-        if (lspLifeTimeTimer->isScheduled()) cancelEvent(lspLifeTimeTimer);
-        scheduleAt(simTime() + lspLifeTimeInterval, lspLifeTimeTimer);
+        if (fisheyeScoping)
+            scheduleScopeTimers();
+        else if (!isNearLspMerged())
+            scheduleAt(simTime() + lspUpdateInterval + uniform(0, maxJitter), lspUpdateTimer);
+
+        if (loadAwareRouting) {
+            cancelEvent(loadSampleTimer);
+            scheduleAt(simTime() + loadSampleInterval, loadSampleTimer);
+        }
 
         if (testTimer && testTimer->isScheduled()) cancelEvent(testTimer);
         if (testTimer) scheduleAt(simTime() + 5.0 + uniform(0,0.1), testTimer);
@@ -368,8 +568,7 @@ void Fsr::sendTestUdpPacket()
     testPkt->insertAtBack(testData);
 
     try {
-        Ipv4Address bcast = Ipv4Address("10.0.0.255");
-        socket.sendTo(testPkt, bcast, fsrPort);
+        socket.sendTo(testPkt, primaryBroadcastAddress, fsrPort);
         // socket.sendTo(testPkt, Ipv4Address::ALLONES_ADDRESS, fsrPort);
         EV_INFO << "Test UDP packet sent successfully!" << endl;
     } catch (const std::exception &e) {
@@ -394,6 +593,8 @@ void Fsr::handleStartOperation(LifecycleOperation *operation)
     }
 
     initNode();
+    nextFullRefresh.assign(scopeIntervals.size(), SIMTIME_ZERO);
+    resetIntervals();
 
     // Log comprehensive system status
     logUdpActivity();
@@ -405,9 +606,12 @@ void Fsr::handleStartOperation(LifecycleOperation *operation)
 
     // Schedule normal timers
     scheduleAt(simTime() + uniform(0, maxJitter), helloBroadcastTimer);
-    scheduleAt(simTime() + lspUpdateInterval + uniform(0, maxJitter), lspUpdateTimer);
-    scheduleAt(simTime() + 1.0, decrementAgeTimer);
-    scheduleAt(simTime() + lspLifeTimeInterval, lspLifeTimeTimer);
+    if (fisheyeScoping)
+        scheduleScopeTimers();
+    else if (!isNearLspMerged())
+        scheduleAt(simTime() + lspUpdateInterval + uniform(0, maxJitter), lspUpdateTimer);
+    if (loadAwareRouting)
+        scheduleAt(simTime() + loadSampleInterval, loadSampleTimer);
 
     EV_INFO << "=== FSR STARTED ===" << endl;
 }
@@ -416,19 +620,31 @@ void Fsr::handleStopOperation(LifecycleOperation *operation)
 {
     cancelEvent(helloBroadcastTimer);
     cancelEvent(lspUpdateTimer);
-    cancelEvent(decrementAgeTimer);
-    cancelEvent(lspLifeTimeTimer);
+    cancelEvent(topologyExpiryTimer);
+    topologyExpiryQueue = decltype(topologyExpiryQueue)();
+    queuedTopologyExpiry.clear();
     cancelEvent(testTimer);
-
-    // Cancel neighbor timeouts
-    for (auto &entry : neighborTimeouts) {
-        cancelAndDelete(entry.second);
-    }
-    neighborTimeouts.clear();
-
+    for (auto timer : scopeTimers)
+        cancelEvent(timer);
+    cancelEvent(lspAggregationTimer);
+    cancelEvent(spfTimer);
+    cancelEvent(loadSampleTimer);
+    spfCurrentHold = spfHoldTime;
+    macDrops = 0;
+    loadAverage = 0;
+    loadLevel = 0;
+    pendingLsps.clear();
+
+    clearNeighbors();
+    mprs.clear();
     clearRoutes();
-    topologyTable.clear();
-    neighbors.clear();
+    linkState.clear();
+    selfId = FsrTopologyTable::NO_ID;
+    lspRequestHoldoff.clear();
+    relayedSeqs.clear();
+    ownEntryAdvertised = false;
+    nextNearRefresh = SIMTIME_ZERO;
+    multipathNextHops.clear();
 }
 
 void Fsr::handleCrashOperation(LifecycleOperation *operation)
@@ -440,6 +656,7 @@ void Fsr::handleMessageWhenUp(cMessage *msg)
 {
     if (msg->isSelfMessage()) {
         if (msg == helloBroadcastTimer) {
+            adaptIntervals();
             sendHelloPacket();
             scheduleAt(simTime() + helloBroadcastInterval + uniform(-maxJitter, maxJitter), helloBroadcastTimer);
         }
@@ -447,12 +664,13 @@ void Fsr::handleMessageWhenUp(cMessage *msg)
             sendTopologyUpdate();
             scheduleAt(simTime() + lspUpdateInterval + uniform(-maxJitter, maxJitter), lspUpdateTimer);
         }
-        else if (msg == decrementAgeTimer) {
-            decrementAge();
-            scheduleAt(simTime() + 1.0, decrementAgeTimer);
+        else if (msg == topologyExpiryTimer) {
+            expireTopology();
         }
-        else if (msg == lspLifeTimeTimer) {
-            scheduleAt(simTime() + lspLifeTimeInterval, lspLifeTimeTimer);
+        else if (fisheyeScoping && msg->getKind() < (short)scopeTimers.size() && msg == scopeTimers[msg->getKind()]) {
+            int scope = msg->getKind();
+            sendScopeUpdate(scope);
+            scheduleAt(simTime() + scopeIntervals[scope] + uniform(-maxJitter, maxJitter), msg);
         }
         else if (msg == testTimer) {
             testDirectCommunication();
@@ -468,16 +686,18 @@ void Fsr::handleMessageWhenUp(cMessage *msg)
             delete msg;
             return;
         }
-        else {
-            // Handle neighbor timeout
-            for (auto it = neighborTimeouts.begin(); it != neighborTimeouts.end(); ++it) {
-                if (it->second == msg) {
-                    removeNeighbor(it->first);
-                    neighborTimeouts.erase(it);
-                    delete msg;
-                    return;
-                }
-            }
+        else if (msg == neighborExpiryTimer) {
+            expireNeighbors();
+        }
+        else if (msg == lspAggregationTimer) {
+            sendPendingLsps();
+        }
+        else if (msg == spfTimer) {
+            runScheduledSpf();
+        }
+        else if (msg == loadSampleTimer) {
+            sampleLoad();
+            scheduleAt(simTime() + loadSampleInterval, loadSampleTimer);
         }
     } else {
         EV_INFO << "Received direct message: " << msg->getName() << endl;
@@ -485,66 +705,111 @@ void Fsr::handleMessageWhenUp(cMessage *msg)
     }
 }
 
+INetfilter::IHook::Result Fsr::datagramPreRoutingHook(Packet *datagram)
+{
+    Enter_Method("datagramPreRoutingHook");
+    return spreadFlow(datagram);
+}
+
+INetfilter::IHook::Result Fsr::datagramLocalOutHook(Packet *datagram)
+{
+    Enter_Method("datagramLocalOutHook");
+    return spreadFlow(datagram);
+}
+
+INetfilter::IHook::Result Fsr::spreadFlow(Packet *datagram)
+{
+    // Only unicast to a reachable FSR destination is steered, everything else follows the routing table
+    if (!isUp() || selfId == FsrTopologyTable::NO_ID)
+        return ACCEPT;
+    const auto &ipv4Header = datagram->peekAtFront<Ipv4Header>();
+    Ipv4Address dest = ipv4Header->getDestAddress();
+    if (dest.isMulticast() || dest.isLimitedBroadcastAddress() || routingTable->isLocalAddress(dest))
+        return ACCEPT;
+    uint32_t id = topologyTable.findId(ipv4ToUint32(dest));
+    if (id == FsrTopologyTable::NO_ID || id == selfId || !spf.isReachable(id))
+        return ACCEPT;
+
+    // The set is computed when a destination is first used after an SPF run
+    auto it = multipathNextHops.find(id);
+    if (it == multipathNextHops.end()) {
+        it = multipathNextHops.emplace(id, std::vector<uint32_t>()).first;
+        linkState.getEqualCostNextHops(id, maxMultipathNextHops, it->second);
+    }
+    const std::vector<uint32_t> &nextHops = it->second;
+    if (nextHops.size() < 2)
+        return ACCEPT;
+
+    // Every packet of a flow takes the same next hop, so TCP sees no reordering from the split
+    size_t index = getFlowHash(datagram, *ipv4Header) % nextHops.size();
+    const NeighborLink *link = findRouteLink(uint32ToIpv4(topologyTable.getAddress(nextHops[index])));
+    if (!link)
+        return ACCEPT;
+    datagram->addTagIfAbsent<InterfaceReq>()->setInterfaceId(link->interfaceId);
+    datagram->addTagIfAbsent<NextHopAddressReq>()->setNextHopAddress(link->address);
+    if (index != 0)
+        numMultipathSteered++;
+    return ACCEPT;
+}
+
+uint32_t Fsr::getFlowHash(Packet *datagram, const Ipv4Header &ipv4Header) const
+{
+    // Addresses, protocol and, for unfragmented UDP, ports; mixed with the own address so
+    // that consecutive relays do not all make the same choice
+    uint32_t key[5] = { ipv4Header.getSrcAddress().getInt(), ipv4Header.getDestAddress().getInt(), (uint32_t)ipv4Header.getProtocolId(), 0, selfAddress.getInt() };
+    if (ipv4Header.getProtocolId() == IP_PROT_UDP && !ipv4Header.getMoreFragments() && ipv4Header.getFragmentOffset() == 0) {
+        const auto &udpHeader = datagram->peekDataAt<UdpHeader>(ipv4Header.getHeaderLength());
+        key[3] = ((uint32_t)udpHeader->getSrcPort() << 16) | (uint32_t)udpHeader->getDestPort();
+    }
+    uint32_t hash = 2166136261u;  // FNV-1a over the key bytes
+    for (uint32_t word : key) {
+        for (int i = 0; i < 4; i++) {
+            hash ^= (word >> (8 * i)) & 0xFF;
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
 void Fsr::socketDataArrived(UdpSocket *socket, Packet *packet)
 {
     numPacketsReceived++;
 
-    EV_INFO << "##########################################" << endl;
-    EV_INFO << "### FSR PACKET RECEIVED ###" << endl;
-    EV_INFO << "Node: " << getContainingNode(this)->getFullName() << endl;
-    EV_INFO << "My IP: " << selfAddress << endl;
-    EV_INFO << "Total packets received so far: " << numPacketsReceived << endl;
-
     auto sourceAddr = packet->getTag<L3AddressInd>()->getSrcAddress();
-    EV_INFO << "From: " << sourceAddr << endl;
-    EV_INFO << "Packet size: " << packet->getTotalLength() << " bytes" << endl;
-    EV_INFO << "Packet name: " << packet->getName() << endl;
+    int interfaceId = packet->getTag<InterfaceInd>()->getInterfaceId();
 
     // Check if this is our test packet
     if (strcmp(packet->getName(), "TestUDP") == 0) {
-        EV_INFO << "*** RECEIVED TEST UDP PACKET - UDP IS WORKING! ***" << endl;
+        EV_INFO << "Received test UDP packet from " << sourceAddr << endl;
         delete packet;
-        EV_INFO << "##########################################" << endl;
         return;
     }
 
-    // Check if packet contains FSR data
-    if (packet->getTotalLength() < b(12)) { // Minimum FSR packet size is 12 bytes
-        EV_WARN << "Packet too small to contain FSR data. Size: " << packet->getTotalLength() << " bytes. Expected at least 12." << endl;
+    if (!fsrInterfaces.empty() && !isFsrInterface(interfaceId)) {
+        EV_DETAIL << "Ignoring FSR packet from " << sourceAddr << " on an interface FSR does not run on" << endl;
         delete packet;
         return;
     }
 
-    EV_INFO << "Packet size OK, attempting to extract bytes..." << endl;
+    // Check if packet contains FSR data
+    if (packet->getTotalLength() < B(1) + FsrPacketSerializer::FSR_HEADER_LENGTH) {
+        EV_WARN << "Packet too small to contain FSR data. Size: " << packet->getTotalLength() << ". Expected at least " << B(1) + FsrPacketSerializer::FSR_HEADER_LENGTH << "." << endl;
+        delete packet;
+        return;
+    }
 
     try {
-        // Get the raw bytes from the packet
-        auto bytesChunk = packet->peekDataAt<BytesChunk>(b(0), packet->getTotalLength());
-        if (!bytesChunk) {
-            EV_WARN << "Could not extract bytes from packet" << endl;
-            delete packet;
-            return;
-        }
-
-        EV_INFO << "Bytes extracted successfully, attempting deserialization..." << endl;
-
-        // Print first few bytes for debugging
-        const auto& bytes = bytesChunk->getBytes();
-        EV_INFO << "First 10 bytes: ";
-        for (size_t i = 0; i < std::min((size_t)10, bytes.size()); i++) {
-            EV_INFO << (int)bytes[i] << " ";
+        // FsrPacket travels as a FieldsChunk, bytes are only decoded by its serializer if the stack produced them
+        auto relayHeader = packet->popAtFront<FsrRelayHeader>();
+        auto fsrPacket = packet->peekAtFront<FsrPacket>();
+        if (fsrPacket->isIncorrect()) {
+            EV_WARN << "Malformed FSR packet from " << sourceAddr << ", dropping" << endl;
+            FSR_TRACE_EVENT(FSR_TRACE_RX, FSR_EV_MALFORMED_PACKET, sourceAddr.toIpv4().getInt(), B(fsrPacket->getChunkLength()).get(), 0);
         }
-        EV_INFO << endl;
-
-        // Deserialize the FSR packet from bytes
-        auto fsrPacket = deserializeFsrPacket(bytesChunk);
-        if (fsrPacket) {
-            EV_INFO << "FSR packet deserialized successfully!" << endl;
-            EV_INFO << "Packet type: " << fsrPacket->getPacketType() << endl;
-            EV_INFO << "Source address: " << uint32ToIpv4(fsrPacket->getSourceAddress()) << endl;
-            processFsrPacket(fsrPacket, sourceAddr);
-        } else {
-            EV_WARN << "Could not deserialize FSR packet" << endl;
+        else {
+            FSR_TRACE_EVENT(FSR_TRACE_RX, FSR_EV_PACKET_RECEIVED, sourceAddr.toIpv4().getInt(),
+                    fsrPacket->getPacketType(), B(fsrPacket->getChunkLength()).get());
+            processFsrPacket(fsrPacket, relayHeader->getHopCount(), sourceAddr, interfaceId);
         }
     }
     catch (const std::exception &e) {
@@ -552,8 +817,6 @@ void Fsr::socketDataArrived(UdpSocket *socket, Packet *packet)
     }
 
     delete packet;
-    EV_INFO << "### END FSR PACKET PROCESSING ###" << endl;
-    EV_INFO << "##########################################" << endl;
 }
 
 void Fsr::socketErrorArrived(UdpSocket *socket, Indication *indication)
@@ -570,187 +833,31 @@ void Fsr::socketClosed(UdpSocket *socket)
     EV_ERROR << "************************" << endl;
 }
 
-Ptr<FsrPacket> Fsr::deserializeFsrPacket(const Ptr<const BytesChunk> &bytesChunk)
-{
-    const auto& bytes = bytesChunk->getBytes();
-    if (bytes.size() < 11) { // Minimum packet size
-        EV_ERROR << "Packet too small for deserialization" << endl;
-        return nullptr;
-    }
-
-    size_t offset = 0;
-
-    try {
-        // Create new FSR packet
-        Ptr<FsrPacket> fsrPacket(new FsrPacket());
-
-        // Deserialize packet type (1 byte)
-        uint8_t packetType = bytes[offset++];
-        fsrPacket->setPacketType(packetType);
-
-        // Deserialize source address (4 bytes) - store as uint32_t
-        uint32_t srcAddr = 0;
-        srcAddr |= ((uint32_t)bytes[offset++]) << 24;
-        srcAddr |= ((uint32_t)bytes[offset++]) << 16;
-        srcAddr |= ((uint32_t)bytes[offset++]) << 8;
-        srcAddr |= ((uint32_t)bytes[offset++]);
-        fsrPacket->setSourceAddress(srcAddr);
-
-        // Deserialize sequence number (4 bytes)
-        uint32_t seq = 0;
-        seq |= ((uint32_t)bytes[offset++]) << 24;
-        seq |= ((uint32_t)bytes[offset++]) << 16;
-        seq |= ((uint32_t)bytes[offset++]) << 8;
-        seq |= ((uint32_t)bytes[offset++]);
-        fsrPacket->setSequenceNumber(seq);
-
-        // Deserialize hop count (1 byte)
-        uint8_t hopCount = bytes[offset++];
-        fsrPacket->setHopCount(hopCount);
-
-        // Set timestamp to current time (not transmitted)
-        fsrPacket->setTimestamp(simTime().dbl());
-
-        // Deserialize LSP entries count (2 bytes)
-        if (offset + 2 > bytes.size()) {
-            EV_ERROR << "Not enough bytes for entry count" << endl;
-            return nullptr;
-        }
-        uint16_t entryCount = 0;
-        entryCount |= ((uint16_t)bytes[offset++]) << 8;
-        entryCount |= ((uint16_t)bytes[offset++]);
-
-        fsrPacket->setLspEntriesArraySize(entryCount);
-
-        // Deserialize LSP entries
-        for (uint16_t i = 0; i < entryCount; i++) {
-            if (offset + 6 > bytes.size()) {
-                EV_ERROR << "Not enough bytes for LSP entry " << i << endl;
-                return nullptr;
-            }
-
-            LspEntry entry;
-
-            // Deserialize node address (4 bytes) - store as uint32_t
-            uint32_t nodeAddr = 0;
-            nodeAddr |= ((uint32_t)bytes[offset++]) << 24;
-            nodeAddr |= ((uint32_t)bytes[offset++]) << 16;
-            nodeAddr |= ((uint32_t)bytes[offset++]) << 8;
-            nodeAddr |= ((uint32_t)bytes[offset++]);
-            entry.setNodeAddress(nodeAddr);
-
-            // Set sequence number
-            entry.setSequenceNumber(seq);
-
-            // Deserialize neighbors count (2 bytes)
-            uint16_t neighborCount = 0;
-            neighborCount |= ((uint16_t)bytes[offset++]) << 8;
-            neighborCount |= ((uint16_t)bytes[offset++]);
-
-            entry.setNeighborsArraySize(neighborCount);
-
-            // Deserialize neighbors (4 bytes each) - store as uint32_t
-            for (uint16_t j = 0; j < neighborCount; j++) {
-                if (offset + 4 > bytes.size()) {
-                    EV_ERROR << "Not enough bytes for neighbor " << j << " in entry " << i << endl;
-                    return nullptr;
-                }
-
-                uint32_t neighborAddr = 0;
-                neighborAddr |= ((uint32_t)bytes[offset++]) << 24;
-                neighborAddr |= ((uint32_t)bytes[offset++]) << 16;
-                neighborAddr |= ((uint32_t)bytes[offset++]) << 8;
-                neighborAddr |= ((uint32_t)bytes[offset++]);
-                entry.setNeighbors(j, neighborAddr);
-            }
-
-            fsrPacket->setLspEntries(i, entry);
-        }
-
-        EV_INFO << "Successfully deserialized FSR packet (type=" << (int)packetType
-                << ", entries=" << entryCount << ", total bytes=" << bytes.size() << ")" << endl;
-
-        return fsrPacket;
-    }
-    catch (const std::exception &e) {
-        EV_ERROR << "Exception during deserialization: " << e.what() << endl;
-        return nullptr;
-    }
-}
-
-std::vector<uint8_t> Fsr::serializeFsrPacket(const Ptr<FsrPacket> &fsrPacket)
-{
-    std::vector<uint8_t> data;
-
-    // Serialize packet type (1 byte)
-    data.push_back((uint8_t)fsrPacket->getPacketType());
-
-    // Serialize source address (4 bytes) - convert from uint32_t
-    uint32_t srcAddr = fsrPacket->getSourceAddress();
-    data.push_back((uint8_t)((srcAddr >> 24) & 0xFF));
-    data.push_back((uint8_t)((srcAddr >> 16) & 0xFF));
-    data.push_back((uint8_t)((srcAddr >> 8) & 0xFF));
-    data.push_back((uint8_t)(srcAddr & 0xFF));
-
-    // Serialize sequence number (4 bytes)
-    uint32_t seq = fsrPacket->getSequenceNumber();
-    data.push_back((uint8_t)((seq >> 24) & 0xFF));
-    data.push_back((uint8_t)((seq >> 16) & 0xFF));
-    data.push_back((uint8_t)((seq >> 8) & 0xFF));
-    data.push_back((uint8_t)(seq & 0xFF));
-
-    // Serialize hop count (1 byte)
-    data.push_back((uint8_t)fsrPacket->getHopCount());
-
-    // Serialize LSP entries count (2 bytes)
-    uint16_t entryCount = fsrPacket->getLspEntriesArraySize();
-    data.push_back((uint8_t)((entryCount >> 8) & 0xFF));
-    data.push_back((uint8_t)(entryCount & 0xFF));
-
-    // Serialize LSP entries
-    for (unsigned int i = 0; i < entryCount; i++) {
-        const LspEntry &entry = fsrPacket->getLspEntries(i);
-
-        // Serialize node address (4 bytes) - already uint32_t
-        uint32_t nodeAddr = entry.getNodeAddress();
-        data.push_back((uint8_t)((nodeAddr >> 24) & 0xFF));
-        data.push_back((uint8_t)((nodeAddr >> 16) & 0xFF));
-        data.push_back((uint8_t)((nodeAddr >> 8) & 0xFF));
-        data.push_back((uint8_t)(nodeAddr & 0xFF));
-
-        // Serialize neighbors count (2 bytes)
-        uint16_t neighborCount = entry.getNeighborsArraySize();
-        data.push_back((uint8_t)((neighborCount >> 8) & 0xFF));
-        data.push_back((uint8_t)(neighborCount & 0xFF));
-
-        // Serialize neighbors (4 bytes each) - already uint32_t
-        for (unsigned int j = 0; j < neighborCount; j++) {
-            uint32_t neighborAddr = entry.getNeighbors(j);
-            data.push_back((uint8_t)((neighborAddr >> 24) & 0xFF));
-            data.push_back((uint8_t)((neighborAddr >> 16) & 0xFF));
-            data.push_back((uint8_t)((neighborAddr >> 8) & 0xFF));
-            data.push_back((uint8_t)(neighborAddr & 0xFF));
-        }
-    }
-
-    return data;
-}
-
-void Fsr::processFsrPacket(const Ptr<const FsrPacket> &packet, const L3Address &sourceAddr)
+void Fsr::processFsrPacket(const Ptr<const FsrPacket> &packet, uint8_t hopCount, const L3Address &sourceAddr, int interfaceId)
 {
     Ipv4Address src = sourceAddr.toIpv4();
 
-    if (src == selfAddress) {
-        EV_INFO << "Ignoring own packet from " << src << endl;
+    if (src == selfAddress || routingTable->isLocalAddress(sourceAddr)) {
         return; // Ignore own packets
     }
 
+    // The sender is known by its interface address, the link state by router ids
+    NeighborLink link{interfaceId, src, simTime()};
+    auto linkNeighbor = linkNeighbors.find(src);
+    Ipv4Address neighbor = linkNeighbor != linkNeighbors.end() ? linkNeighbor->second : src;
+
+    long length = B(packet->getChunkLength()).get();
     switch (packet->getPacketType()) {
         case HELLO:
-            processHello(packet, src);
+            emit(helloReceivedSignal, length);
+            processHello(packet, link);
             break;
         case LSP:
-            processLSP(packet, src);
+            emit(lspReceivedSignal, length);
+            processLSP(packet, hopCount, neighbor, link);
+            break;
+        case LSP_REQUEST:
+            processLspRequest(packet, link);
             break;
         default:
             EV_WARN << "Unknown FSR packet type: " << packet->getPacketType() << endl;
@@ -758,91 +865,246 @@ void Fsr::processFsrPacket(const Ptr<const FsrPacket> &packet, const L3Address &
     }
 }
 
-void Fsr::processHello(const Ptr<const FsrPacket> &packet, const Ipv4Address &sourceAddr)
+void Fsr::processHello(const Ptr<const FsrPacket> &packet, const NeighborLink &link)
 {
-    EV_INFO << "*** PROCESSING HELLO ***" << endl;
-    EV_INFO << "From: " << sourceAddr << endl;
-    EV_INFO << "Current neighbors count: " << neighbors.size() << endl;
-
-    addNeighbor(sourceAddr);
-
-    EV_INFO << "After adding neighbor, count: " << neighbors.size() << endl;
-    EV_INFO << "Neighbors: ";
-    for (const auto &neighbor : neighbors) {
-        EV_INFO << neighbor << " ";
+    // The sender says how long to wait for its next HELLO, its interval may differ from ours
+    Ipv4Address sourceAddr = uint32ToIpv4(packet->getSourceAddress());
+    uint16_t holdTime = packet->getHoldTime();
+    addNeighbor(sourceAddr, holdTime > 0 ? SimTime(holdTime * FsrWireCodec::HOLD_TIME_UNIT) : neighborHoldTime, link);
+    if (routingMetric == METRIC_ETX)
+        updateLinkQuality(sourceAddr, packet);
+
+    // Combined mode: entries on a HELLO are link state for the 1-hop audience, never relayed
+    if (helloLinkState && packet->getLspEntriesArraySize() > 0)
+        processLSP(packet, 1, sourceAddr, link);
+
+    if (relaySuppression == RELAY_MPR) {
+        // The sender's neighbor list gives our 2-hop neighborhood, its MPR list says whether we relay for it
+        NeighborState &state = neighborStates[sourceAddr];
+        state.neighbors.clear();
+        if (helloLinkState) {
+            // Its entry may have arrived as a delta, the topology table holds the complete list
+            uint32_t id = topologyTable.findId(ipv4ToUint32(sourceAddr));
+            if (id != FsrTopologyTable::NO_ID && topologyTable.hasEntry(id)) {
+                for (uint32_t neighbor : topologyTable.getNeighbors(id))
+                    state.neighbors.push_back(topologyTable.getAddress(neighbor));
+            }
+        }
+        else if (packet->getLspEntriesArraySize() > 0) {
+            const LspEntry &entry = packet->getLspEntries(0);
+            for (unsigned int i = 0; i < entry.getNeighborsArraySize(); i++)
+                state.neighbors.push_back(entry.getNeighbors(i));
+        }
+        state.mprSelector = false;
+        for (unsigned int i = 0; i < packet->getMprsArraySize(); i++) {
+            if (packet->getMprs(i) == ipv4ToUint32(selfAddress))
+                state.mprSelector = true;
+        }
     }
-    EV_INFO << endl;
-    EV_INFO << "*** END PROCESSING HELLO ***" << endl;
+
+    FSR_TRACE_EVENT(FSR_TRACE_HELLO, FSR_EV_HELLO_RECEIVED, ipv4ToUint32(sourceAddr), packet->getSequenceNumber(), neighbors.size());
 }
 
-void Fsr::processLSP(const Ptr<const FsrPacket> &packet, const Ipv4Address &sourceAddr)
+void Fsr::processLSP(const Ptr<const FsrPacket> &packet, uint8_t hopCount, const Ipv4Address &neighbor, const NeighborLink &link)
 {
     // Update statistics
     numLSPsReceived++;
 
-    EV_INFO << "*** PROCESSING LSP ***" << endl;
-    EV_INFO << "From: " << sourceAddr << endl;
-
-    // Process the LSP - update topology table
-    Ipv4Address originator = uint32ToIpv4(packet->getSourceAddress());
-    uint32_t seq = packet->getSequenceNumber();
-
-    // Check if this is a newer LSP
-    auto it = topologyTable.find(originator);
-    if (it != topologyTable.end()) {
-        if (seq <= it->second.seq) {
-            EV_INFO << "Ignoring old/duplicate LSP from " << originator << " (seq " << seq << ")" << endl;
-            return;
+    // Every entry carries its own originator and sequence number
+    bool updated = false;
+    bool relay = hopCount > 1 && isRelayAllowed(neighbor);
+    bool relayEntries = lspAggregationWindow > 0 || relaySuppression == RELAY_COUNTER;
+    lspRequests.clear();
+    lateRelays.clear();
+    for (unsigned int i = 0; i < packet->getLspEntriesArraySize(); i++) {
+        const LspEntry &lspEntry = packet->getLspEntries(i);
+        Ipv4Address originator = uint32ToIpv4(lspEntry.getNodeAddress());
+        uint32_t seq = lspEntry.getSequenceNumber();
+
+        // Our own entry is maintained locally, echoes of it carry nothing new
+        if (originator == selfAddress)
+            continue;
+
+        // Check if this is a newer entry
+        uint32_t id = linkState.intern(lspEntry.getNodeAddress());
+        FsrLinkState::ApplyResult result = linkState.applyEntry(id, lspEntry, simTime().dbl());
+        if (result == FsrLinkState::APPLY_STALE) {
+            // Another copy of a version we are about to relay
+            auto pending = pendingLsps.find(lspEntry.getNodeAddress());
+            if (pending != pendingLsps.end() && pending->second.entry.getSequenceNumber() == seq)
+                pending->second.copies++;
+            // MPR mode: the accepted copy may have come from a neighbor that did not select us,
+            // the stored version is then still relayed once for an MPR selector
+            if (relay && relaySuppression == RELAY_MPR && seq == topologyTable.getSeq(id) && !isRelayed(id, seq))
+                lateRelays.push_back(i);
+            emit(lspDuplicateSignal, 1L);
+            FSR_TRACE_EVENT(FSR_TRACE_LSP, FSR_EV_LSP_ENTRY_STALE, lspEntry.getNodeAddress(), seq, topologyTable.getSeq(id));
+            continue;
+        }
+        if (result == FsrLinkState::APPLY_GAP) {
+            FSR_TRACE_EVENT(FSR_TRACE_LSP, FSR_EV_LSP_DELTA_GAP, lspEntry.getNodeAddress(), seq, lspEntry.getBaseSequenceNumber());
+            if (id >= lspRequestHoldoff.size())
+                lspRequestHoldoff.resize(topologyTable.getNumIds(), SIMTIME_ZERO);
+            if (simTime() >= lspRequestHoldoff[id]) {
+                lspRequestHoldoff[id] = simTime() + helloBroadcastInterval;
+                lspRequests.push_back(lspEntry.getNodeAddress());
+            }
+            continue;
+        }
+        armTopologyExpiry(id);
+        updated = true;
+        if (relay && relaySuppression == RELAY_MPR)
+            markRelayed(id, seq);
+
+        // With aggregation or counter suppression, only the accepted entries are relayed, after a delay
+        if (relayEntries && hopCount > 1) {
+            if (relay)
+                queueLspEntry(lspEntry, hopCount - 1, true);
+            else
+                countRelaySuppressed();
         }
+
+        FSR_TRACE_EVENT(FSR_TRACE_LSP, FSR_EV_LSP_ENTRY_ACCEPTED, lspEntry.getNodeAddress(), seq, topologyTable.getNeighbors(id).size());
     }
 
-    // Update topology table
-    tt_entry_t &entry = topologyTable[originator];
-    entry.seq = seq;
-    entry.age = 0;
-    entry.ls.clear();
+    // Entries that could not be applied are fetched in full from the neighbor that sent them
+    if (!lspRequests.empty())
+        sendLspRequest(link);
 
-    // Extract LSP entries
-    for (unsigned int i = 0; i < packet->getLspEntriesArraySize(); i++) {
+    // Late copies travel with the packet if it is relayed below, otherwise on their own
+    bool relayPacket = updated && !relayEntries && relay;
+    for (unsigned int i : lateRelays) {
         const LspEntry &lspEntry = packet->getLspEntries(i);
-        Ipv4Address nodeAddr = uint32ToIpv4(lspEntry.getNodeAddress());
+        if (!relayPacket)
+            queueLspEntry(lspEntry, hopCount - 1, true);
+        markRelayed(topologyTable.findId(lspEntry.getNodeAddress()), lspEntry.getSequenceNumber());
+    }
+
+    if (!updated)
+        return;
 
-        // Add the node itself to the topology
-        entry.ls.insert(nodeAddr);
+    // Recalculate shortest paths once the burst settles
+    scheduleSpf();
 
-        // Add all neighbors of this node
-        for (unsigned int j = 0; j < lspEntry.getNeighborsArraySize(); j++) {
-            Ipv4Address neighborAddr = uint32ToIpv4(lspEntry.getNeighbors(j));
-            entry.ls.insert(neighborAddr);
+    // Relay if hops remain: only the per-hop header is new, the received LSP chunk is shared as is
+    if (!relayEntries && hopCount > 1) {
+        if (relay) {
+            sendFsrPacket(packet, hopCount - 1, Ipv4Address::ALLONES_ADDRESS);
+            countRelaySent();
+            FSR_TRACE_EVENT(FSR_TRACE_RELAY, FSR_EV_LSP_RELAYED, packet->getSourceAddress(), packet->getSequenceNumber(), hopCount - 1);
         }
+        else
+            countRelaySuppressed();
     }
+}
+
+bool Fsr::isRelayed(uint32_t id, uint32_t seq) const
+{
+    return id < relayedSeqs.size() && relayedSeqs[id] == seq;
+}
 
-    EV_INFO << "Updated topology from " << originator << " (seq " << seq << ")" << endl;
+void Fsr::markRelayed(uint32_t id, uint32_t seq)
+{
+    if (id >= relayedSeqs.size())
+        relayedSeqs.resize(topologyTable.getNumIds(), NOT_RELAYED);
+    relayedSeqs[id] = seq;
+}
 
-    // Recalculate shortest paths
-    calculateShortestPath();
+bool Fsr::isRelayAllowed(const Ipv4Address &sender) const
+{
+    // In MPR mode only floods from neighbors that selected this node are repeated
+    if (relaySuppression != RELAY_MPR)
+        return true;
+    auto it = neighborStates.find(sender);
+    return it != neighborStates.end() && it->second.mprSelector;
+}
 
-    // Relay if hops remain
-    if (packet->getHopCount() > 1) {
-        // Build a fresh chunk and copy all fields
-        Ptr<FsrPacket> relay(new FsrPacket());
-        relay->setPacketType(packet->getPacketType());
-        relay->setSourceAddress(packet->getSourceAddress());
-        relay->setSequenceNumber(packet->getSequenceNumber());
-        relay->setTimestamp(packet->getTimestamp());
-        relay->setHopCount(packet->getHopCount() - 1);
+void Fsr::countRelaySuppressed()
+{
+    numRelaysSuppressed++;
+    emit(relaySuppressedSignal, 1L);
+}
 
-        unsigned int n = packet->getLspEntriesArraySize();
-        relay->setLspEntriesArraySize(n);
-        for (unsigned int i = 0; i < n; ++i)
-            relay->setLspEntries(i, packet->getLspEntries(i));
+void Fsr::countRelaySent()
+{
+    numRelaysSent++;
+    emit(lspRelayedSignal, 1L);
+}
 
-        // Send the relay packet using the helper function
-        sendFsrPacketHelper(relay, Ipv4Address::ALLONES_ADDRESS);
+void Fsr::computeMprs()
+{
+    // Greedy selection: neighbors that are the only way to some strict 2-hop neighbor first,
+    // then the one covering the most 2-hop neighbors still uncovered
+    mprs.clear();
+    uint32_t self = ipv4ToUint32(selfAddress);
+    std::map<uint32_t, std::vector<Ipv4Address>> coveredBy;
+    for (const auto &neighbor : neighborStates) {
+        for (uint32_t twoHop : neighbor.second.neighbors) {
+            if (twoHop != self && neighbors.find(uint32ToIpv4(twoHop)) == neighbors.end())
+                coveredBy[twoHop].push_back(neighbor.first);
+        }
+    }
+
+    std::set<uint32_t> uncovered;
+    for (const auto &entry : coveredBy)
+        uncovered.insert(entry.first);
+    auto select = [&](const Ipv4Address &mpr) {
+        if (!mprs.insert(mpr).second)
+            return;
+        for (uint32_t twoHop : neighborStates[mpr].neighbors)
+            uncovered.erase(twoHop);
+    };
 
-        EV_INFO << "Relayed LSP (new hopCount=" << (int)relay->getHopCount() << ")" << endl;
+    for (const auto &entry : coveredBy) {
+        if (entry.second.size() == 1)
+            select(entry.second.front());
     }
-    EV_INFO << "*** END PROCESSING LSP ***" << endl;
+    while (!uncovered.empty()) {
+        const Ipv4Address *best = nullptr;
+        size_t bestCount = 0;
+        for (const auto &neighbor : neighborStates) {
+            if (mprs.count(neighbor.first))
+                continue;
+            size_t count = 0;
+            for (uint32_t twoHop : neighbor.second.neighbors)
+                count += uncovered.count(twoHop);
+            if (count > bestCount) {
+                best = &neighbor.first;
+                bestCount = count;
+            }
+        }
+        if (!best)
+            break;
+        select(*best);
+    }
+}
+
+void Fsr::processLspRequest(const Ptr<const FsrPacket> &packet, const NeighborLink &link)
+{
+    // Answer with full entries, unicast to the requesting neighbor over the interface it asked on
+    Ptr<FsrPacket> fsrchunk;
+    for (unsigned int i = 0; i < packet->getLspEntriesArraySize(); i++) {
+        uint32_t id = topologyTable.findId(packet->getLspEntries(i).getNodeAddress());
+        if (id == FsrTopologyTable::NO_ID || !topologyTable.hasEntry(id))
+            continue;
+        LspEntry entry;
+        fillLspEntry(entry, id, true);
+        appendLspEntry(fsrchunk, entry, link.address, 1, link.interfaceId);
+    }
+    flushLspPacket(fsrchunk, link.address, 1, link.interfaceId);
+}
+
+void Fsr::sendLspRequest(const NeighborLink &link)
+{
+    Ptr<FsrPacket> fsrchunk(new FsrPacket());
+    fsrchunk->setPacketType(LSP_REQUEST);
+    fsrchunk->setSourceAddress(ipv4ToUint32(selfAddress));
+    fsrchunk->setSequenceNumber(sequenceNumber);
+    fsrchunk->setTimestamp(simTime().dbl());
+    fsrchunk->setLspEntriesArraySize(lspRequests.size());
+    for (size_t i = 0; i < lspRequests.size(); i++)
+        fsrchunk->getLspEntriesForUpdate(i).setNodeAddress(lspRequests[i]);
+    sendFsrPacketHelper(fsrchunk, link.address, 1, link.interfaceId);
 }
 
 void Fsr::sendHelloPacket()
@@ -854,27 +1116,56 @@ void Fsr::sendHelloPacket()
     Ptr<FsrPacket> fsrchunk(new FsrPacket());
     fsrchunk->setPacketType(HELLO);
     fsrchunk->setSourceAddress(ipv4ToUint32(selfAddress)); // Convert to uint32_t
-    fsrchunk->setSequenceNumber(++sequenceNumber);
+    fsrchunk->setSequenceNumber(++helloSequenceNumber);
     fsrchunk->setTimestamp(simTime().dbl()); // Convert to double
-    fsrchunk->setHopCount(1);
+    fsrchunk->setHoldTime((uint16_t)std::min(65535.0, std::ceil(neighborHoldTime.dbl() / FsrWireCodec::HOLD_TIME_UNIT)));
+
+    // MPR mode: advertise the 1-hop neighbor set and the relays chosen from it
+    if (relaySuppression == RELAY_MPR) {
+        computeMprs();
+        if (!helloLinkState) {
+            LspEntry entry;
+            entry.setNodeAddress(ipv4ToUint32(selfAddress));
+            entry.setSequenceNumber(sequenceNumber);
+            entry.setLoad(getOwnLoad());
+            entry.setNeighborsArraySize(neighbors.size());
+            int i = 0;
+            for (const auto &neighbor : neighbors)
+                entry.setNeighbors(i++, ipv4ToUint32(neighbor));
+            fsrchunk->appendLspEntries(entry);
+        }
+        fsrchunk->setMprsArraySize(mprs.size());
+        int i = 0;
+        for (const auto &mpr : mprs)
+            fsrchunk->setMprs(i++, ipv4ToUint32(mpr));
+    }
+
+    // ETX metric: tell every neighbor how many of its HELLOs arrive here, that is its forward ratio
+    if (routingMetric == METRIC_ETX) {
+        fsrchunk->setReportedNeighborsArraySize(neighborStates.size());
+        fsrchunk->setDeliveryRatiosArraySize(neighborStates.size());
+        int i = 0;
+        for (const auto &neighbor : neighborStates) {
+            fsrchunk->setReportedNeighbors(i, ipv4ToUint32(neighbor.first));
+            fsrchunk->setDeliveryRatios(i++, (uint8_t)std::lround(255 * neighbor.second.reverseRatio));
+        }
+    }
+
+    // Combined mode: the own entry (and when due, the near-scope update) rides along
+    if (helloLinkState)
+        piggybackLinkState(fsrchunk);
 
     // Send the packet using the helper function
-    sendFsrPacketHelper(fsrchunk, Ipv4Address::ALLONES_ADDRESS);
+    sendFsrPacketHelper(fsrchunk, Ipv4Address::ALLONES_ADDRESS, 1);
 
     // Stats
     numHellosSent++;
-    EV_INFO << "Sent HELLO packet (seq=" << sequenceNumber << ")" << endl;
 }
 
 void Fsr::sendTopologyUpdate()
 {
-    if (selfAddress.isUnspecified() || neighbors.empty()) {
-        EV_INFO << "Skipping LSP: no neighbors or invalid address" << endl;
+    if (selfAddress.isUnspecified() || neighbors.empty())
         return;
-    }
-
-    EV_INFO << "*** SENDING LSP UPDATE ***" << endl;
-    EV_INFO << "Neighbors count: " << neighbors.size() << endl;
 
     // Build FsrPacket chunk
     Ptr<FsrPacket> fsrchunk(new FsrPacket());
@@ -882,95 +1173,334 @@ void Fsr::sendTopologyUpdate()
     fsrchunk->setSourceAddress(ipv4ToUint32(selfAddress)); // Convert to uint32_t
     fsrchunk->setSequenceNumber(++sequenceNumber);
     fsrchunk->setTimestamp(simTime().dbl()); // Convert to double
-    fsrchunk->setHopCount(10);
 
     // Create one LSP entry for this node
-    fsrchunk->setLspEntriesArraySize(1);
+    updateOwnEntry();
     LspEntry entry;
-    entry.setNodeAddress(ipv4ToUint32(selfAddress)); // Convert to uint32_t
-    entry.setSequenceNumber(sequenceNumber);
-
-    // Fill in neighbors array
-    entry.setNeighborsArraySize(neighbors.size());
-    int i = 0;
-    for (const auto &neighbor : neighbors) {
-        entry.setNeighbors(i++, ipv4ToUint32(neighbor)); // Convert to uint32_t
+    fillLspEntry(entry, selfId, isFullRefreshDue(0));
+    if (lspAggregationWindow > 0) {
+        queueLspEntry(entry, lspFloodHopCount, false);
+        return;
     }
-
-    fsrchunk->setLspEntries(0, entry);
+    fsrchunk->appendLspEntries(entry);
 
     // Send the packet using the helper function
-    sendFsrPacketHelper(fsrchunk, Ipv4Address::ALLONES_ADDRESS);
+    sendFsrPacketHelper(fsrchunk, Ipv4Address::ALLONES_ADDRESS, lspFloodHopCount);
 
     // Stats
     numLSPsSent++;
-    EV_INFO << "Sent LSP (seq=" << sequenceNumber << ")" << endl;
-    EV_INFO << "*** END SENDING LSP UPDATE ***" << endl;
 }
 
-void Fsr::sendFsrPacketHelper(const Ptr<FsrPacket> &fsrPacket, const Ipv4Address &destAddr)
+void Fsr::scheduleScopeTimers()
 {
-    EV_INFO << "##########################################" << endl;
-    EV_INFO << "### SENDING FSR PACKET ###" << endl;
-    EV_INFO << "Node: " << getContainingNode(this)->getFullName() << endl;
-    EV_INFO << "My IP: " << selfAddress << endl;
-    EV_INFO << "Destination: " << destAddr << endl;
-    EV_INFO << "Packet type: " << fsrPacket->getPacketType() << endl;
+    // Spread the first round so scopes do not fire together; HELLOs take over scope 0 in combined mode
+    for (size_t i = isNearLspMerged() ? 1 : 0; i < scopeTimers.size(); i++) {
+        if (scopeTimers[i]->isScheduled())
+            cancelEvent(scopeTimers[i]);
+        scheduleAt(simTime() + uniform(0, scopeIntervals[i]) + uniform(0, maxJitter), scopeTimers[i]);
+    }
+}
 
-    Ipv4Address finalDestAddr = destAddr;
-    if (destAddr == Ipv4Address::ALLONES_ADDRESS) {
-        if (!primaryBroadcastAddress.isUnspecified() && primaryBroadcastAddress != Ipv4Address::ALLONES_ADDRESS) {
-            finalDestAddr = primaryBroadcastAddress;
-            EV_INFO << "Redirecting ALLONES_ADDRESS to subnet broadcast: " << finalDestAddr << endl;
-        } else {
-            EV_WARN << "Attempting to use ALLONES_ADDRESS as broadcast, but specific subnet broadcast was not determined or is ALLONES. Current primaryBroadcastAddress: " << primaryBroadcastAddress << endl;
+bool Fsr::isNearLspMerged() const
+{
+    // The separate update reaches exactly the HELLO audience: any fisheye scope, or a 1-hop flood
+    return helloLinkState && (fisheyeScoping || lspFloodHopCount == 1);
+}
+
+void Fsr::piggybackLinkState(const Ptr<FsrPacket> &hello)
+{
+    if (selfId == FsrTopologyTable::NO_ID)
+        return;
+
+    // Entries that would make the HELLO too large go out as a regular 1-hop LSP
+    Ptr<FsrPacket> overflow;
+    auto append = [&](const LspEntry &entry) {
+        if (FsrPacketSerializer::getSerializedLength(*hello) + FsrPacketSerializer::getSerializedLength(entry) <= B(maxLspPacketSize))
+            hello->appendLspEntries(entry);
+        else
+            appendLspEntry(overflow, entry, Ipv4Address::ALLONES_ADDRESS);
+    };
+
+    if (isNearLspMerged() && simTime() >= nextNearRefresh) {
+        // Stands in for the scope 0 update (or 1-hop flood): a fresh own sequence number keeps the entry alive
+        nextNearRefresh = simTime() + (fisheyeScoping ? scopeIntervals[0] : lspUpdateInterval);
+        ++sequenceNumber;
+        updateOwnEntry();
+        bool full = isFullRefreshDue(0);
+        int numEntries = 0;
+        for (uint32_t id = 0; id < topologyTable.getNumIds(); id++) {
+            bool near = id == selfId || (fisheyeScoping && getScope(id) == 0);
+            if (!topologyTable.hasEntry(id) || !near)
+                continue;
+            LspEntry entry;
+            fillLspEntry(entry, id, full);
+            append(entry);
+            numEntries++;
         }
+        FSR_TRACE_EVENT(FSR_TRACE_LSP, FSR_EV_SCOPE_UPDATE_SENT, 0, numEntries, 0);
     }
+    else if (!ownEntryAdvertised || topologyTable.getStableSeq(selfId) > advertisedOwnSeq) {
+        // Own neighbors changed since the last advertisement
+        LspEntry entry;
+        fillLspEntry(entry, selfId, false);
+        append(entry);
+    }
+    flushLspPacket(overflow, Ipv4Address::ALLONES_ADDRESS);
+}
 
-    EV_INFO << "Node: " << getContainingNode(this)->getFullName() << endl;
-    EV_INFO << "My IP: " << selfAddress << endl;
-    EV_INFO << "Destination: " << finalDestAddr << " (Original dest: " << destAddr << ")" << endl; // Log both
-    EV_INFO << "Packet type: " << fsrPacket->getPacketType() << endl;
+int Fsr::getScope(uint32_t id) const
+{
+    // Unreachable entries belong to the outermost scope; radii count hops whatever the metric
+    uint32_t hopCount = spf.getHopCount(id);
+    for (size_t i = 0; i < scopeRadii.size(); i++) {
+        if (hopCount <= scopeRadii[i])
+            return (int)i;
+    }
+    return (int)scopeRadii.size();
+}
 
-    // Check UDP socket status
-    logUdpActivity();
+void Fsr::fillLspEntry(LspEntry &entry, uint32_t id, bool full)
+{
+    uint32_t seq = topologyTable.getSeq(id);
+    uint32_t stableSeq = topologyTable.getStableSeq(id);
+    auto neighborIds = topologyTable.getNeighbors(id);
+    // Only ETX costs are advertised, a table weighted for load penalties alone holds UNIT_COST per link
+    const FsrTopologyTable::LinkCost *costs = routingMetric == METRIC_ETX ? topologyTable.getCosts(id) : nullptr;
+    entry.setNodeAddress(topologyTable.getAddress(id));
+    entry.setSequenceNumber(seq);
+    entry.setLoad(topologyTable.getLoad(id));
+
+    if (!full && id == selfId && ownEntryAdvertised && stableSeq > advertisedOwnSeq) {
+        // Own neighbors changed since the last advertisement, send the difference against it;
+        // both lists are sorted, a neighbor whose cost changed is added again with the new cost
+        std::vector<uint32_t> added, removed;
+        std::vector<FsrTopologyTable::LinkCost> addedCosts;
+        size_t j = 0;
+        for (size_t i = 0; i < neighborIds.size(); i++) {
+            uint32_t neighbor = neighborIds.begin()[i];
+            while (j < advertisedOwnNeighbors.size() && advertisedOwnNeighbors[j] < neighbor)
+                removed.push_back(advertisedOwnNeighbors[j++]);
+            bool known = j < advertisedOwnNeighbors.size() && advertisedOwnNeighbors[j] == neighbor;
+            if (!known || (costs && costs[i] != advertisedOwnCosts[j])) {
+                added.push_back(neighbor);
+                if (costs)
+                    addedCosts.push_back(costs[i]);
+            }
+            if (known)
+                j++;
+        }
+        removed.insert(removed.end(), advertisedOwnNeighbors.begin() + j, advertisedOwnNeighbors.end());
+        entry.setDelta(true);
+        entry.setBaseSequenceNumber(advertisedOwnSeq);
+        entry.setNeighborsArraySize(added.size());
+        for (size_t i = 0; i < added.size(); i++)
+            entry.setNeighbors(i, topologyTable.getAddress(added[i]));
+        entry.setLinkCostsArraySize(addedCosts.size());
+        for (size_t i = 0; i < addedCosts.size(); i++)
+            entry.setLinkCosts(i, addedCosts[i]);
+        entry.setRemovedNeighborsArraySize(removed.size());
+        for (size_t i = 0; i < removed.size(); i++)
+            entry.setRemovedNeighbors(i, topologyTable.getAddress(removed[i]));
+    }
+    else if (!full && stableSeq < seq) {
+        // Unchanged since stableSeq, an empty delta moves every version from there on to seq
+        entry.setDelta(true);
+        entry.setBaseSequenceNumber(stableSeq);
+    }
+    else {
+        entry.setNeighborsArraySize(neighborIds.size());
+        int i = 0;
+        for (uint32_t neighbor : neighborIds)
+            entry.setNeighbors(i++, topologyTable.getAddress(neighbor));
+        if (costs) {
+            entry.setLinkCostsArraySize(neighborIds.size());
+            for (size_t j = 0; j < neighborIds.size(); j++)
+                entry.setLinkCosts(j, costs[j]);
+        }
+    }
+
+    if (id == selfId) {
+        advertisedOwnNeighbors.assign(neighborIds.begin(), neighborIds.end());
+        if (costs)
+            advertisedOwnCosts.assign(costs, costs + neighborIds.size());
+        advertisedOwnSeq = seq;
+        ownEntryAdvertised = true;
+    }
+}
+
+bool Fsr::isFullRefreshDue(int index)
+{
+    if (!deltaLsp)
+        return true;
+    if (simTime() < nextFullRefresh[index])
+        return false;
+    nextFullRefresh[index] = simTime() + lspFullRefreshInterval;
+    return true;
+}
+
+void Fsr::appendLspEntry(Ptr<FsrPacket> &fsrchunk, const LspEntry &entry, const Ipv4Address &destAddr, uint8_t hopCount, int interfaceId)
+{
+    B entrySize = FsrPacketSerializer::getSerializedLength(entry);
+    if (fsrchunk && FsrPacketSerializer::getSerializedLength(*fsrchunk) + entrySize > B(maxLspPacketSize))
+        flushLspPacket(fsrchunk, destAddr, hopCount, interfaceId);
+    if (!fsrchunk) {
+        fsrchunk = Ptr<FsrPacket>(new FsrPacket());
+        fsrchunk->setPacketType(LSP);
+        fsrchunk->setSourceAddress(ipv4ToUint32(selfAddress));
+        fsrchunk->setSequenceNumber(sequenceNumber);
+        fsrchunk->setTimestamp(simTime().dbl());
+    }
+    fsrchunk->appendLspEntries(entry);
+}
+
+void Fsr::flushLspPacket(Ptr<FsrPacket> &fsrchunk, const Ipv4Address &destAddr, uint8_t hopCount, int interfaceId)
+{
+    if (!fsrchunk)
+        return;
+    sendFsrPacketHelper(fsrchunk, destAddr, hopCount, interfaceId);
+    numLSPsSent++;
+    fsrchunk = nullptr;
+}
+
+void Fsr::queueLspEntry(const LspEntry &entry, uint8_t hopCount, bool relayed)
+{
+    // Keep the newest version per originator, the wider remaining scope on equal versions
+    auto result = pendingLsps.emplace(entry.getNodeAddress(), PendingLsp{hopCount, entry, relayed, 1});
+    if (!result.second) {
+        PendingLsp &pending = result.first->second;
+        uint32_t pendingSeq = pending.entry.getSequenceNumber();
+        if (entry.getSequenceNumber() > pendingSeq) {
+            // A delta may reach fewer receivers than the entry it replaces, then the table's full entry is sent
+            bool covers = !entry.getDelta()
+                    || (pending.entry.getDelta() && entry.getBaseSequenceNumber() <= pending.entry.getBaseSequenceNumber());
+            if (covers)
+                pending.entry = entry;
+            else {
+                LspEntry fullEntry;
+                fillLspEntry(fullEntry, topologyTable.findId(entry.getNodeAddress()), true);
+                pending.entry = fullEntry;
+            }
+            pending.hopCount = std::max(pending.hopCount, hopCount);
+            pending.relayed = relayed;
+            pending.copies = 1;
+        }
+        else if (entry.getSequenceNumber() == pendingSeq)
+            pending.hopCount = std::max(pending.hopCount, hopCount);
+    }
+
+    // Without an aggregation window, counter suppression still waits a random jitter for copies
+    if (!lspAggregationTimer->isScheduled())
+        scheduleAt(simTime() + (lspAggregationWindow > 0 ? lspAggregationWindow : uniform(0, relayJitter)), lspAggregationTimer);
+}
+
+void Fsr::sendPendingLsps()
+{
+    // One packet (or more, if too large) per remaining hop count, which lives in the relay header
+    std::map<uint8_t, Ptr<FsrPacket>> packets;
+    for (auto &pending : pendingLsps) {
+        // Counter suppression: enough neighbors already repeated this version
+        if (relaySuppression == RELAY_COUNTER && pending.second.relayed && pending.second.copies >= relayCounterThreshold) {
+            countRelaySuppressed();
+            continue;
+        }
+        appendLspEntry(packets[pending.second.hopCount], pending.second.entry, Ipv4Address::ALLONES_ADDRESS, pending.second.hopCount);
+        if (pending.second.relayed) {
+            countRelaySent();
+            FSR_TRACE_EVENT(FSR_TRACE_RELAY, FSR_EV_LSP_RELAYED, pending.first, pending.second.entry.getSequenceNumber(), pending.second.hopCount);
+        }
+    }
+    for (auto &packet : packets)
+        flushLspPacket(packet.second, Ipv4Address::ALLONES_ADDRESS, packet.first);
+    pendingLsps.clear();
+}
+
+void Fsr::sendScopeUpdate(int scope)
+{
+    if (selfAddress.isUnspecified() || neighbors.empty())
+        return;
+
+    // A fresh sequence number on the own entry keeps it alive in the neighbors' tables
+    if (scope == 0) {
+        ++sequenceNumber;
+        updateOwnEntry();
+    }
+
+    // Entries are exchanged with direct neighbors only, the scope sets how often
+    bool full = isFullRefreshDue(scope);
+    Ptr<FsrPacket> fsrchunk;
+    int numEntries = 0;
+    for (uint32_t id = 0; id < topologyTable.getNumIds(); id++) {
+        if (!topologyTable.hasEntry(id) || getScope(id) != scope)
+            continue;
+
+        LspEntry entry;
+        fillLspEntry(entry, id, full);
+        appendLspEntry(fsrchunk, entry, Ipv4Address::ALLONES_ADDRESS);
+        numEntries++;
+    }
+    flushLspPacket(fsrchunk, Ipv4Address::ALLONES_ADDRESS);
+    FSR_TRACE_EVENT(FSR_TRACE_LSP, FSR_EV_SCOPE_UPDATE_SENT, scope, numEntries, 0);
+}
+
+void Fsr::sendFsrPacketHelper(const Ptr<FsrPacket> &fsrPacket, const Ipv4Address &destAddr, uint8_t hopCount, int interfaceId)
+{
+    // The chunk length is the exact wire length, the serializer runs only if bytes are needed
+    fsrPacket->setChunkLength(FsrPacketSerializer::getSerializedLength(*fsrPacket));
+
+    sendFsrPacket(fsrPacket, hopCount, destAddr, interfaceId);
+}
 
-    // Serialize the FSR packet to bytes
-    std::vector<uint8_t> data = serializeFsrPacket(fsrPacket);
-    EV_INFO << "Serialized data size: " << data.size() << " bytes" << endl;
+void Fsr::sendFsrPacket(const Ptr<const FsrPacket> &fsrPacket, uint8_t hopCount, const Ipv4Address &destAddr, int interfaceId)
+{
+    if (interfaceId >= 0 || destAddr != Ipv4Address::ALLONES_ADDRESS || fsrInterfaces.empty()) {
+        sendFsrPacketOnInterface(fsrPacket, hopCount, destAddr, interfaceId);
+        return;
+    }
 
-    // Print first few bytes for debugging
-    EV_INFO << "First 10 bytes: ";
-    for (size_t i = 0; i < std::min((size_t)10, data.size()); i++) {
-        EV_INFO << (int)data[i] << " ";
+    // Broadcasts: HELLOs go out on every interface so each discovers its own neighbors,
+    // LSPs too unless they are spread over the interfaces (the chunk is shared by all copies)
+    if (spreadLsps && fsrPacket->getPacketType() != HELLO) {
+        NetworkInterface *ie = fsrInterfaces[nextLspInterface++ % fsrInterfaces.size()];
+        sendFsrPacketOnInterface(fsrPacket, hopCount, destAddr, ie->getInterfaceId());
     }
-    EV_INFO << endl;
+    else {
+        for (NetworkInterface *ie : fsrInterfaces)
+            sendFsrPacketOnInterface(fsrPacket, hopCount, destAddr, ie->getInterfaceId());
+    }
+}
 
+void Fsr::sendFsrPacketOnInterface(const Ptr<const FsrPacket> &fsrPacket, uint8_t hopCount, const Ipv4Address &destAddr, int interfaceId)
+{
     // Create packet with proper name based on type
-    const char *packetName = (fsrPacket->getPacketType() == HELLO) ? "FSR-HELLO" : "FSR-LSP";
+    const char *packetName = (fsrPacket->getPacketType() == HELLO) ? "FSR-HELLO" :
+            (fsrPacket->getPacketType() == LSP_REQUEST) ? "FSR-LSPREQ" : "FSR-LSP";
     Packet *pkt = new Packet(packetName);
 
-    // Create BytesChunk from the serialized data
-    auto chunk = Ptr<BytesChunk>(new BytesChunk(data));
-    pkt->insertAtBack(chunk);
-
-    EV_INFO << "Created packet '" << packetName << "' with size: " << pkt->getByteLength() << " bytes" << endl;
+    // Per-hop header first, then the (possibly shared) immutable FSR chunk
+    Ptr<FsrRelayHeader> relayHeader(new FsrRelayHeader());
+    relayHeader->setHopCount(hopCount);
+    pkt->insertAtBack(relayHeader);
+    pkt->insertAtBack(fsrPacket);
+    if (interfaceId >= 0)
+        pkt->addTag<InterfaceReq>()->setInterfaceId(interfaceId);
 
     try {
-        EV_INFO << "Attempting to send via UDP socket..." << endl;
-
         // Send via UDP socket
+        int length = pkt->getByteLength();
         socket.sendTo(pkt, destAddr, fsrPort);
-        controlBytesSent += pkt->getByteLength();
-
-        EV_INFO << "Packet sent successfully via socket!" << endl;
+        controlBytesSent += length;
+        switch (fsrPacket->getPacketType()) {
+            case HELLO: emit(helloSentSignal, (long)length); break;
+            case LSP: emit(lspSentSignal, (long)length); break;
+            case LSP_REQUEST: emit(lspRequestSentSignal, (long)length); break;
+        }
+        emit(controlSentSignal, (long)length);
+        FSR_TRACE_EVENT(FSR_TRACE_TX, FSR_EV_PACKET_SENT, ipv4ToUint32(destAddr), fsrPacket->getPacketType(), length);
     }
     catch (const std::exception &e) {
         EV_ERROR << "Error sending FSR packet: " << e.what() << endl;
         delete pkt; // Clean up if send failed
     }
-    EV_INFO << "### END SENDING ###" << endl;
-    EV_INFO << "##########################################" << endl;
 }
 
 void Fsr::sendMessageToNeighbors(const Ptr<FsrPacket> &payload)
@@ -985,102 +1515,232 @@ void Fsr::calculateShortestPath()
         return;
     }
 
-    // Clear existing routes
-    clearRoutes();
+    // The whole result reaches the routing table as one batch: one cache invalidation, net changes only
+    if (batchRoutingTable)
+        batchRoutingTable->beginBatch();
+
+    // Full rebuild only when differential installation is disabled
+    if (!incrementalRouteUpdate)
+        clearRoutes();
+
+    // Our own entry holds the current neighbor set, so the table is the whole graph
+    if (selfId == FsrTopologyTable::NO_ID)
+        initNode();
+
+    // After an incremental run only the destinations it reports need their routes revisited
+    emit(topologySizeSignal, (long)topologyTable.size());
+    multipathNextHops.clear();
+    bool incremental = linkState.computeShortestPaths(selfId, spfChanged);
+    if (incremental) {
+        FSR_TRACE_EVENT(FSR_TRACE_SPF, FSR_EV_SPF_RUN, spf.getNumNodes(), topologyTable.size(), spfChanged.size());
+        emit(spfRunSignal, (long)spfChanged.size());
+    }
+    else {
+        FSR_TRACE_EVENT(FSR_TRACE_SPF, FSR_EV_SPF_RUN, spf.getNumNodes(), topologyTable.size(), spf.getNumNodes());
+        emit(spfRunSignal, (long)spf.getNumNodes());
+    }
+    // Routes the table deleted by itself are missing outside the changed destinations too
+    updateRoutes(incremental && !routesLost ? &spfChanged : nullptr);
+    routesLost = false;
 
-    // Dijkstra's algorithm implementation
-    std::map<Ipv4Address, uint32_t> dist;
-    std::map<Ipv4Address, Ipv4Address> prev;
-    std::set<Ipv4Address> visited;
+    if (batchRoutingTable)
+        batchRoutingTable->commitBatch();
+}
 
-    // Initialize distances
-    dist[selfAddress] = 0;
-    for (const auto &entry : topologyTable) {
-        if (entry.first != selfAddress) {
-            dist[entry.first] = UINT32_MAX;
-        }
+void Fsr::setTopologyEntry(uint32_t id, uint32_t seq, std::vector<uint32_t> &neighborIds, std::vector<FsrTopologyTable::LinkCost> *costs)
+{
+    linkState.setEntry(id, seq, neighborIds, simTime().dbl(), costs);
+    armTopologyExpiry(id);
+}
+
+void Fsr::armTopologyExpiry(uint32_t id)
+{
+    // Entries of other nodes expire lifeTime after their last update; refreshes only move the
+    // update time, the queue entry is re-armed when it comes due
+    if (id == selfId)
+        return;
+    if (id >= queuedTopologyExpiry.size())
+        queuedTopologyExpiry.resize(topologyTable.getNumIds(), SIMTIME_ZERO);
+    if (queuedTopologyExpiry[id] == SIMTIME_ZERO) {
+        simtime_t expiry = simTime() + lifeTime;
+        queuedTopologyExpiry[id] = expiry;
+        topologyExpiryQueue.push(TopologyExpiry{expiry, id});
+        if (!topologyExpiryTimer->isScheduled())
+            scheduleAt(expiry, topologyExpiryTimer);
     }
+}
+
+void Fsr::removeTopologyEntry(uint32_t id)
+{
+    linkState.removeEntry(id);
+    if (id < queuedTopologyExpiry.size())
+        queuedTopologyExpiry[id] = SIMTIME_ZERO; // its queue entry is stale now
+}
 
-    // Add direct neighbors
-    for (const auto &neighbor : neighbors) {
-        dist[neighbor] = 1;
-        prev[neighbor] = neighbor;
+void Fsr::scheduleSpf()
+{
+    // Changes arriving while a run is pending are covered by that run
+    if (spfTimer->isScheduled()) {
+        numSpfAvoided++;
+        emit(spfAvoidedSignal, 1L);
+        return;
     }
 
-    // Dijkstra's main loop
-    while (visited.size() < topologyTable.size() + 1) {
-        // Find minimum distance unvisited node
-        Ipv4Address current;
-        uint32_t minDist = UINT32_MAX;
-        bool found = false;
+    // Throttling as in link-state routers: the first change after a quiet period waits spfInitialDelay,
+    // later ones keep at least spfCurrentHold from the previous run, and the hold doubles up to
+    // spfMaxHoldTime while changes keep coming
+    simtime_t now = simTime();
+    if (now - lastSpfRun > 2 * spfCurrentHold)
+        spfCurrentHold = spfHoldTime;
+    simtime_t runAt = now + spfInitialDelay;
+    if (lastSpfRun + spfCurrentHold > runAt)
+        runAt = lastSpfRun + spfCurrentHold;
+    scheduleAt(runAt, spfTimer);
+}
 
-        for (const auto &d : dist) {
-            if (visited.find(d.first) == visited.end() && d.second < minDist) {
-                current = d.first;
-                minDist = d.second;
-                found = true;
-            }
-        }
+void Fsr::runScheduledSpf()
+{
+    calculateShortestPath();
+    numSpfRuns++;
+    lastSpfRun = simTime();
+    spfCurrentHold = std::min(2 * spfCurrentHold, spfMaxHoldTime);
+}
 
-        if (!found || minDist == UINT32_MAX) {
-            break;
+void Fsr::updateRoutes(const std::vector<uint32_t> *changedIds)
+{
+    int added = 0, changed = 0, deleted = 0;
+
+    // After an incremental run only the touched destinations can differ from what is installed
+    if (changedIds) {
+        for (uint32_t index : *changedIds)
+            updateRoute(index, added, changed, deleted);
+    }
+    else {
+        for (uint32_t index = 0; index < spf.getNumNodes(); index++)
+            updateRoute(index, added, changed, deleted);
+    }
+
+    FSR_TRACE_EVENT(FSR_TRACE_ROUTE, FSR_EV_ROUTES_UPDATED, added, changed, deleted);
+    if (added)
+        emit(routesAddedSignal, (long)added);
+    if (changed)
+        emit(routesChangedSignal, (long)changed);
+    if (deleted)
+        emit(routesDeletedSignal, (long)deleted);
+    EV_DETAIL << "Updated routes (added=" << added << ", changed=" << changed << ", deleted=" << deleted << ")" << endl;
+}
+
+void Fsr::updateRoute(uint32_t index, int &added, int &changed, int &deleted)
+{
+    if (index == spf.getSource())
+        return;
+
+    Ipv4Address dest = uint32ToIpv4(topologyTable.getAddress(index));
+    auto it = installedRoutes.find(dest);
+
+    // Drop the installed route if the destination became unreachable
+    if (!spf.isReachable(index)) {
+        if (it != installedRoutes.end()) {
+            // Forgotten first, the deletion notification must not find it
+            Ipv4Route *route = it->second;
+            installedRoutes.erase(it);
+            routingTable->deleteRoute(route);
+            deleted++;
         }
+        return;
+    }
 
-        visited.insert(current);
-
-        // Update distances to neighbors of current node
-        auto it = topologyTable.find(current);
-        if (it != topologyTable.end()) {
-            for (const auto &neighbor : it->second.ls) {
-                if (visited.find(neighbor) == visited.end()) {
-                    uint32_t newDist = dist[current] + 1;
-                    if (newDist < dist[neighbor]) {
-                        dist[neighbor] = newDist;
-                        if (current == selfAddress) {
-                            prev[neighbor] = neighbor;
-                        } else {
-                            prev[neighbor] = prev[current];
-                        }
-                    }
-                }
-            }
+    // The first hop is a router id, the route goes to its address on the interface it was heard on
+    Ipv4Address nextHop = uint32ToIpv4(topologyTable.getAddress(spf.getNextHop(index)));
+    NetworkInterface *ie = getRouteInterface();
+    if (const NeighborLink *link = findRouteLink(nextHop)) {
+        nextHop = link->address;
+        ie = interfaceTable->getInterfaceById(link->interfaceId);
+    }
+    // Hops, or the path cost in 1/100 ETX units with the ETX metric; a table weighted only for
+    // load penalties would otherwise install 100 x hops plus penalties
+    uint32_t metric = routingMetric == METRIC_HOP_COUNT ? spf.getHopCount(index) : spf.getDistance(index);
+    if (it == installedRoutes.end()) {
+        Ipv4Route *route = createRoute(dest, nextHop, metric, ie);
+        if (route) {
+            installedRoutes[dest] = route;
+            added++;
         }
+        return;
+    }
+
+    // Only touch the fields that differ, each setter fires one change notification
+    Ipv4Route *route = it->second;
+    bool modified = false;
+    if (route->getGateway() != nextHop) {
+        route->setGateway(nextHop);
+        modified = true;
     }
+    if (ie && route->getInterface() != ie) {
+        route->setInterface(ie);
+        modified = true;
+    }
+    if (route->getMetric() != (int)metric) {
+        route->setMetric(metric);
+        modified = true;
+    }
+    if (modified)
+        changed++;
+}
 
-    updateRoutes(prev);
+NetworkInterface *Fsr::getRouteInterface()
+{
+    if (routeInterface || !interfaceTable)
+        return routeInterface;
+
+    // Resolved once, the interface set does not change during the run
+    if (!fsrInterfaces.empty())
+        routeInterface = fsrInterfaces.front();
+    return routeInterface;
 }
 
-void Fsr::updateRoutes(std::map<Ipv4Address, Ipv4Address> &prev)
+void Fsr::resolveInterfaces()
 {
-    for (const auto &entry : prev) {
-        if (entry.first != selfAddress && entry.first != entry.second) {
-            createRoute(entry.first, entry.second, 1);
-        }
+    fsrInterfaces.clear();
+    cPatternMatcher interfaceMatcher(par("interfaces"), false, true, false);
+    for (int i = 0; i < interfaceTable->getNumInterfaces(); i++) {
+        NetworkInterface *ie = interfaceTable->getInterface(i);
+        if (!ie->isLoopback() && interfaceMatcher.matches(ie->getInterfaceName()))
+            fsrInterfaces.push_back(ie);
+    }
+    if (fsrInterfaces.empty())
+        EV_WARN << "No interface matches '" << par("interfaces").stringValue() << "', FSR sends without choosing one" << endl;
+    for (NetworkInterface *ie : fsrInterfaces)
+        EV_INFO << "FSR runs on " << ie->getInterfaceName() << " (ID: " << ie->getInterfaceId() << ")" << endl;
+}
+
+bool Fsr::isFsrInterface(int interfaceId) const
+{
+    for (NetworkInterface *ie : fsrInterfaces) {
+        if (ie->getInterfaceId() == interfaceId)
+            return true;
     }
+    return false;
+}
 
-    EV_INFO << "Updated routes for " << prev.size() << " destinations" << endl;
+const Fsr::NeighborLink *Fsr::findRouteLink(const Ipv4Address &neighbor) const
+{
+    auto it = neighborStates.find(neighbor);
+    if (it == neighborStates.end() || it->second.links.empty())
+        return nullptr;
+    return &it->second.links.front();
 }
 
-void Fsr::createRoute(const Ipv4Address &dst, const Ipv4Address &nexthop, uint32_t hopCount)
+Ipv4Route *Fsr::createRoute(const Ipv4Address &dst, const Ipv4Address &nexthop, uint32_t metric, NetworkInterface *ie)
 {
     if (!routingTable || !interfaceTable) {
         EV_ERROR << "Cannot create route: tables not available" << endl;
-        return;
-    }
-
-    // Find appropriate interface
-    NetworkInterface *ie = nullptr;
-    for (int i = 0; i < interfaceTable->getNumInterfaces(); i++) {
-        NetworkInterface *iface = interfaceTable->getInterface(i);
-        if (iface->isWireless() && !iface->isLoopback()) {
-            ie = iface;
-            break;
-        }
+        return nullptr;
     }
 
     if (!ie) {
         EV_ERROR << "No suitable interface found for route to " << dst << endl;
-        return;
+        return nullptr;
     }
 
     // Create route
@@ -1090,9 +1750,10 @@ void Fsr::createRoute(const Ipv4Address &dst, const Ipv4Address &nexthop, uint32
     route->setNextHop(nexthop);
     route->setInterface(ie);
     route->setSourceType(IRoute::MANET);
-    route->setMetric(hopCount);
+    route->setMetric(metric);
 
     routingTable->addRoute(route);
+    return route;
 }
 
 void Fsr::clearRoutes()
@@ -1101,92 +1762,410 @@ void Fsr::clearRoutes()
         return;
     }
 
+    installedRoutes.clear();
+
     // Remove all MANET routes
+    if (batchRoutingTable)
+        batchRoutingTable->beginBatch();
     for (int i = routingTable->getNumRoutes() - 1; i >= 0; i--) {
         IRoute *route = routingTable->getRoute(i);
         if (route->getSourceType() == IRoute::MANET) {
             routingTable->deleteRoute(route);
         }
     }
+    if (batchRoutingTable)
+        batchRoutingTable->commitBatch();
 }
 
-void Fsr::addNeighbor(const Ipv4Address &neighbor)
+void Fsr::addNeighbor(const Ipv4Address &neighbor, simtime_t holdTime, const NeighborLink &link)
 {
-    if (neighbors.find(neighbor) == neighbors.end()) {
-        neighbors.insert(neighbor);
+    simtime_t now = simTime();
+    simtime_t expiry = now + holdTime;
+    auto it = neighborStates.find(neighbor);
+    if (it != neighborStates.end()) {
+        // Known neighbor: no event is touched, the queue entry is re-armed when it comes due,
+        // unless a shorter advertised hold time makes it too late
+        NeighborState &state = it->second;
+        state.lastHeard = now;
+        state.holdTime = holdTime;
+        if (expiry < state.queuedExpiry)
+            queueNeighborExpiry(neighbor, state, expiry);
+
+        // Heard on another interface: a further link, the routes stay on the first one
+        auto known = std::find_if(state.links.begin(), state.links.end(),
+                [&](const NeighborLink &l) { return l.interfaceId == link.interfaceId && l.address == link.address; });
+        if (known != state.links.end())
+            known->lastHeard = now;
+        else {
+            state.links.push_back(link);
+            linkNeighbors[link.address] = neighbor;
+        }
+        return;
+    }
+
+    neighbors.insert(neighbor);
+    NeighborState &state = neighborStates[neighbor];
+    state.lastHeard = now;
+    state.holdTime = holdTime;
+    state.links.push_back(link);
+    linkNeighbors[link.address] = neighbor;
+    queueNeighborExpiry(neighbor, state, expiry);
+
+    updateOwnEntry();
+    noteNeighborChange();
 
-        // Cancel existing timeout timer
-        auto it = neighborTimeouts.find(neighbor);
-        if (it != neighborTimeouts.end()) {
-            cancelAndDelete(it->second);
+    FSR_TRACE_EVENT(FSR_TRACE_NEIGHBOR, FSR_EV_NEIGHBOR_ADDED, ipv4ToUint32(neighbor), neighbors.size(), 0);
+    emit(neighborCountSignal, (long)neighbors.size());
+    scheduleSpf();
+}
+
+void Fsr::queueNeighborExpiry(const Ipv4Address &neighbor, NeighborState &state, simtime_t expiry)
+{
+    // The entry queued before, if any, no longer matches queuedExpiry and is skipped
+    state.queuedExpiry = expiry;
+    neighborExpiryQueue.push(NeighborExpiry{expiry, neighbor});
+    if (!neighborExpiryTimer->isScheduled() || expiry < neighborExpiryTimer->getArrivalTime())
+        rescheduleAt(expiry, neighborExpiryTimer);
+}
+
+void Fsr::expireNeighbors()
+{
+    simtime_t now = simTime();
+    while (!neighborExpiryQueue.empty() && neighborExpiryQueue.top().expiry <= now) {
+        NeighborExpiry due = neighborExpiryQueue.top();
+        neighborExpiryQueue.pop();
+
+        // Entries of removed (or removed and re-added) neighbors are stale
+        auto it = neighborStates.find(due.neighbor);
+        if (it == neighborStates.end() || it->second.queuedExpiry != due.expiry)
+            continue;
+
+        simtime_t expiry = it->second.lastHeard + it->second.holdTime;
+        if (expiry > now) {
+            it->second.queuedExpiry = expiry;
+            neighborExpiryQueue.push(NeighborExpiry{expiry, due.neighbor});
+            pruneNeighborLinks(due.neighbor, it->second, now);
         }
+        else
+            removeNeighbor(due.neighbor);
+    }
 
-        // Create new timeout timer
-        cMessage *timeoutMsg = new cMessage("neighborTimeout");
-        neighborTimeouts[neighbor] = timeoutMsg;
-        scheduleAt(simTime() + 3 * helloBroadcastInterval, timeoutMsg);
+    if (!neighborExpiryQueue.empty())
+        scheduleAt(neighborExpiryQueue.top().expiry, neighborExpiryTimer);
+}
 
-        EV_INFO << "Added neighbor: " << neighbor << endl;
-        EV_INFO << "Total neighbors now: " << neighbors.size() << endl;
-    } else {
-        // Reset timeout timer
-        auto it = neighborTimeouts.find(neighbor);
-        if (it != neighborTimeouts.end()) {
-            cancelEvent(it->second);
-            scheduleAt(simTime() + 3 * helloBroadcastInterval, it->second);
+void Fsr::pruneNeighborLinks(const Ipv4Address &neighbor, NeighborState &state, simtime_t now)
+{
+    // Still alive on some interface: drop the silent ones, checked whenever the neighbor's expiry is re-armed
+    if (state.links.empty())
+        return;
+    Ipv4Address routeAddress = state.links.front().address;
+    for (auto link = state.links.begin(); link != state.links.end(); ) {
+        if (link->lastHeard + state.holdTime <= now) {
+            linkNeighbors.erase(link->address);
+            link = state.links.erase(link);
         }
-        EV_INFO << "Refreshed neighbor timeout: " << neighbor << endl;
+        else
+            ++link;
+    }
+
+    // Routes through the neighbor move to its next link
+    if (!state.links.empty() && state.links.front().address != routeAddress && spf.getNumNodes() > 0) {
+        if (batchRoutingTable)
+            batchRoutingTable->beginBatch();
+        updateRoutes();
+        if (batchRoutingTable)
+            batchRoutingTable->commitBatch();
     }
 }
 
+void Fsr::clearNeighbors()
+{
+    cancelEvent(neighborExpiryTimer);
+    neighborExpiryQueue = decltype(neighborExpiryQueue)();
+    neighborStates.clear();
+    linkNeighbors.clear();
+    neighbors.clear();
+}
+
 void Fsr::removeNeighbor(const Ipv4Address &neighbor)
 {
+    auto it = neighborStates.find(neighbor);
+    if (it != neighborStates.end()) {
+        for (const auto &link : it->second.links)
+            linkNeighbors.erase(link.address);
+    }
     neighbors.erase(neighbor);
+    neighborStates.erase(neighbor);
+    updateOwnEntry();
+    noteNeighborChange();
+
+    FSR_TRACE_EVENT(FSR_TRACE_NEIGHBOR, FSR_EV_NEIGHBOR_REMOVED, ipv4ToUint32(neighbor), neighbors.size(), 0);
+    emit(neighborCountSignal, (long)neighbors.size());
 
-    auto it = neighborTimeouts.find(neighbor);
-    if (it != neighborTimeouts.end()) {
-        cancelAndDelete(it->second);
-        neighborTimeouts.erase(it);
+    // Recalculate routes
+    scheduleSpf();
+}
+
+void Fsr::noteNeighborChange()
+{
+    lastNeighborChange = simTime();
+    if (!adaptiveIntervals || ++neighborChanges < (uint32_t)intervalChurnThreshold)
+        return;
+    if (helloBroadcastInterval == helloIntervalMin && lspUpdateInterval == lspIntervalMin)
+        return;
+
+    // Churn: back to the shortest intervals at once, pending timers are pulled in
+    setHelloInterval(helloIntervalMin);
+    setLspInterval(lspIntervalMin);
+    simtime_t now = simTime();
+    if (helloBroadcastTimer->isScheduled() && helloBroadcastTimer->getArrivalTime() > now + helloBroadcastInterval)
+        rescheduleAt(now + uniform(0, helloBroadcastInterval), helloBroadcastTimer);
+    if (lspUpdateTimer->isScheduled() && lspUpdateTimer->getArrivalTime() > now + lspUpdateInterval)
+        rescheduleAt(now + uniform(0, lspUpdateInterval), lspUpdateTimer);
+    for (size_t i = 0; i < scopeTimers.size(); i++) {
+        if (scopeTimers[i]->isScheduled() && scopeTimers[i]->getArrivalTime() > now + scopeIntervals[i])
+            rescheduleAt(now + uniform(0, scopeIntervals[i]), scopeTimers[i]);
     }
+    nextNearRefresh = std::min(nextNearRefresh, now + (fisheyeScoping ? scopeIntervals[0] : lspUpdateInterval));
+}
 
-    EV_INFO << "Removed neighbor: " << neighbor << endl;
-    EV_INFO << "Total neighbors now: " << neighbors.size() << endl;
+void Fsr::updateLinkQuality(const Ipv4Address &neighbor, const Ptr<const FsrPacket> &hello)
+{
+    auto it = neighborStates.find(neighbor);
+    if (it == neighborStates.end())
+        return;
+    NeighborState &state = it->second;
+
+    // Reverse ratio: every HELLO is one sample of an exponential average, a numbering gap
+    // counts as that many lost ones; copies heard on further interfaces are no new sample
+    uint32_t seq = hello->getSequenceNumber();
+    double alpha = 1 / etxWindow;
+    if (state.lastHelloSeq != 0 && seq > state.lastHelloSeq) {
+        uint32_t missed = std::min<uint32_t>(seq - state.lastHelloSeq - 1, (uint32_t)std::ceil(etxWindow) * 4);
+        state.reverseRatio = (1 - alpha) * state.reverseRatio * std::pow(1 - alpha, missed) + alpha;
+    }
+    if (seq != state.lastHelloSeq)
+        state.lastHelloSeq = seq;   // also after a restart of the neighbor
 
-    // Recalculate routes
-    calculateShortestPath();
+    // Forward ratio: the neighbor reports how many of our HELLOs it receives
+    for (size_t i = 0; i < hello->getReportedNeighborsArraySize(); i++) {
+        if (hello->getReportedNeighbors(i) == ipv4ToUint32(selfAddress))
+            state.forwardRatio = hello->getDeliveryRatios(i) / 255.0;
+    }
+
+    // Small fluctuations stay local, each advertised change costs a new own entry and SPF runs
+    FsrTopologyTable::LinkCost cost = computeLinkCost(state);
+    if (std::abs((double)cost - state.linkCost) > etxChangeThreshold * state.linkCost) {
+        state.linkCost = cost;
+        updateOwnEntry();
+        scheduleSpf();
+    }
 }
 
-void Fsr::decrementAge()
+FsrTopologyTable::LinkCost Fsr::computeLinkCost(const NeighborState &state) const
 {
-    auto it = topologyTable.begin();
-    while (it != topologyTable.end()) {
-        it->second.age++;
-        if (it->second.age > lifeTime) {
-            EV_INFO << "Removing expired topology entry for " << it->first << endl;
-            it = topologyTable.erase(it);
-        } else {
-            ++it;
+    // ETX = 1 / (df * dr); until the neighbor reports, the link is taken as symmetric
+    double forward = state.forwardRatio >= 0 ? state.forwardRatio : state.reverseRatio;
+    double deliveryProduct = std::max(0.01, forward * state.reverseRatio);
+    return (FsrTopologyTable::LinkCost)std::min(65535.0, std::round(FsrTopologyTable::UNIT_COST / deliveryProduct));
+}
+
+void Fsr::resolveLoadSources()
+{
+    // Queues are found per interface; drops anywhere inside an interface module reach its listeners
+    loadQueues.clear();
+    std::vector<std::string> paths = cStringTokenizer(par("loadQueueModules").stringValue()).asVector();
+    for (NetworkInterface *ie : fsrInterfaces) {
+        queueing::IPacketCollection *queue = nullptr;
+        for (size_t i = 0; i < paths.size() && !queue; i++)
+            queue = dynamic_cast<queueing::IPacketCollection *>(ie->findModuleByPath(paths[i].c_str()));
+        if (queue)
+            loadQueues.push_back(queue);
+        else
+            EV_WARN << "No MAC queue found in " << ie->getInterfaceName() << ", its load counts drops only" << endl;
+        ie->subscribe(packetDroppedSignal, this);
+    }
+}
+
+void Fsr::receiveSignal(cComponent *source, simsignal_t signalID, cObject *obj, cObject *details)
+{
+    Enter_Method_Silent();
+    if (signalID == routeDeletedSignal) {
+        // Only routes deleted behind FSR's back are still listed, the map must not keep dangling pointers
+        auto route = dynamic_cast<Ipv4Route *>(obj);
+        auto it = route ? installedRoutes.find(route->getDestination()) : installedRoutes.end();
+        if (it != installedRoutes.end() && it->second == route) {
+            EV_INFO << "Routing table deleted the route to " << route->getDestination() << ", reinstalling on the next SPF run" << endl;
+            installedRoutes.erase(it);
+            routesLost = true;
+            scheduleSpf();
         }
+        return;
+    }
+    if (signalID != packetDroppedSignal)
+        return;
+    // Only drops that come from congestion, not frames the MAC filters or fails to decode
+    auto dropDetails = dynamic_cast<PacketDropDetails *>(details);
+    if (!dropDetails)
+        return;
+    switch (dropDetails->getReason()) {
+        case QUEUE_OVERFLOW:
+        case RETRY_LIMIT_REACHED:
+        case LIFETIME_EXPIRED:
+        case CONGESTION:
+            macDrops++;
+            break;
+        default:
+            break;
     }
 }
 
+void Fsr::sampleLoad()
+{
+    // The fullest queue and the drop rate since the last sample, each as a share of saturation
+    double occupancy = 0;
+    for (auto queue : loadQueues) {
+        int capacity = queue->getMaxNumPackets() > 0 ? queue->getMaxNumPackets() : loadQueueLength;
+        occupancy = std::max(occupancy, std::min(1.0, (double)queue->getNumPackets() / capacity));
+    }
+    double drops = std::min(1.0, macDrops / loadSampleInterval / loadDropRate);
+    macDrops = 0;
+    loadAverage = (1 - loadSmoothing) * loadAverage + loadSmoothing * std::max(occupancy, drops);
+
+    // Hysteresis: the average has to pass a step boundary by loadHysteresis to move the level,
+    // so that routes do not flap while it hovers around a boundary
+    double step = 1.0 / loadLevels;
+    int level = loadLevel;
+    while (level + 1 < loadLevels && loadAverage >= (level + 1) * step + loadHysteresis)
+        level++;
+    while (level > 0 && loadAverage < level * step - loadHysteresis)
+        level--;
+    if (level == loadLevel)
+        return;
+    EV_INFO << "Load level " << loadLevel << " -> " << level << " (average " << loadAverage << ")" << endl;
+    loadLevel = level;
+    emit(loadLevelSignal, (long)level);
+    updateOwnEntry();
+}
+
+uint8_t Fsr::getOwnLoad() const
+{
+    return loadAwareRouting ? (uint8_t)std::lround(255.0 * loadLevel / (loadLevels - 1)) : 0;
+}
+
+void Fsr::adaptIntervals()
+{
+    // Runs before every HELLO: a whole interval without neighbor changes doubles it, up to the ceiling
+    if (adaptiveIntervals) {
+        simtime_t now = simTime();
+        if (helloBroadcastInterval < helloIntervalMax && now - std::max(lastNeighborChange, lastHelloBackoff) >= helloBroadcastInterval) {
+            setHelloInterval(std::min(helloIntervalMax, 2 * helloBroadcastInterval));
+            lastHelloBackoff = now;
+        }
+        if (lspUpdateInterval < lspIntervalMax && now - std::max(lastNeighborChange, lastLspBackoff) >= lspUpdateInterval) {
+            setLspInterval(std::min(lspIntervalMax, 2 * lspUpdateInterval));
+            lastLspBackoff = now;
+        }
+    }
+    neighborChanges = 0;
+}
+
+void Fsr::resetIntervals()
+{
+    // Adaptive intervals start at the fast end and back off while the neighborhood stays quiet
+    neighborChanges = 0;
+    lastNeighborChange = lastHelloBackoff = lastLspBackoff = simTime();
+    setHelloInterval(adaptiveIntervals ? helloIntervalMin : par("helloBroadcastInterval").doubleValue());
+    setLspInterval(adaptiveIntervals ? lspIntervalMin : par("lspUpdateInterval").doubleValue());
+}
+
+void Fsr::setHelloInterval(double interval)
+{
+    helloBroadcastInterval = interval;
+    neighborHoldTime = 3 * interval;
+    emit(helloIntervalSignal, interval);
+}
+
+void Fsr::setLspInterval(double interval)
+{
+    lspUpdateInterval = interval;
+    for (size_t i = 0; i < scopeIntervalFactors.size(); i++)
+        scopeIntervals[i] = scopeIntervalFactors[i] * interval;
+    emit(lspIntervalSignal, interval);
+}
+
+void Fsr::expireTopology()
+{
+    simtime_t now = simTime();
+    bool removed = false;
+    while (!topologyExpiryQueue.empty() && topologyExpiryQueue.top().expiry <= now) {
+        TopologyExpiry due = topologyExpiryQueue.top();
+        topologyExpiryQueue.pop();
+        if (queuedTopologyExpiry[due.id] != due.expiry)
+            continue;
+
+        simtime_t expiry = topologyTable.getUpdateTime(due.id) + lifeTime;
+        if (expiry > now) {
+            queuedTopologyExpiry[due.id] = expiry;
+            topologyExpiryQueue.push(TopologyExpiry{expiry, due.id});
+            continue;
+        }
+        EV_INFO << "Removing expired topology entry for " << uint32ToIpv4(topologyTable.getAddress(due.id)) << endl;
+        FSR_TRACE_EVENT(FSR_TRACE_LSP, FSR_EV_LSP_ENTRY_EXPIRED, topologyTable.getAddress(due.id), topologyTable.getSeq(due.id), 0);
+        removeTopologyEntry(due.id);
+        removed = true;
+    }
+
+    // Routes through expired nodes are gone
+    if (removed)
+        scheduleSpf();
+    if (!topologyExpiryQueue.empty())
+        scheduleAt(topologyExpiryQueue.top().expiry, topologyExpiryTimer);
+}
+
 void Fsr::initNode()
 {
     // Initialize own entry in topology table
-    tt_entry_t &ownEntry = topologyTable[selfAddress];
-    ownEntry.seq = 0;
-    ownEntry.age = 0;
-    ownEntry.ls.clear();
+    selfId = linkState.intern(ipv4ToUint32(selfAddress));
+    updateOwnEntry();
+}
+
+void Fsr::updateOwnEntry()
+{
+    // Own link state mirrors the neighbor set and never ages out
+    if (selfId == FsrTopologyTable::NO_ID)
+        return;
+    lsLinkScratch.clear();
+    for (const auto &neighbor : neighbors)
+        lsLinkScratch.push_back(std::make_pair(linkState.intern(ipv4ToUint32(neighbor)), neighborStates[neighbor].linkCost));
+    std::sort(lsLinkScratch.begin(), lsLinkScratch.end());
+    lsScratch.clear();
+    lsCostScratch.clear();
+    for (const auto &link : lsLinkScratch) {
+        lsScratch.push_back(link.first);
+        lsCostScratch.push_back(link.second);
+    }
+    bool etx = routingMetric == METRIC_ETX;
+    uint8_t load = getOwnLoad();
+    // Each version of the own entry has exactly one neighbor list (and costs and load), deltas rely on it
+    if (topologyTable.hasEntry(selfId) && topologyTable.getSeq(selfId) == sequenceNumber
+            && (!topologyTable.hasNeighbors(selfId, lsScratch, etx ? lsCostScratch.data() : nullptr) || topologyTable.getLoad(selfId) != load))
+        ++sequenceNumber;
+    setTopologyEntry(selfId, sequenceNumber, lsScratch, etx ? &lsCostScratch : nullptr);
+    linkState.setLoad(selfId, load);
 }
 
 void Fsr::printTopologyTable()
 {
     EV_INFO << "=== Topology Table ===" << endl;
-    for (const auto &entry : topologyTable) {
-        EV_INFO << "Node: " << entry.first << " Seq: " << entry.second.seq
-                << " Age: " << entry.second.age << " Neighbors: ";
-        for (const auto &neighbor : entry.second.ls) {
-            EV_INFO << neighbor << " ";
+    for (uint32_t id = 0; id < topologyTable.getNumIds(); id++) {
+        if (!topologyTable.hasEntry(id))
+            continue;
+        EV_INFO << "Node: " << uint32ToIpv4(topologyTable.getAddress(id)) << " Seq: " << topologyTable.getSeq(id)
+                << " Updated: " << topologyTable.getUpdateTime(id) << "s Neighbors: ";
+        for (uint32_t neighbor : topologyTable.getNeighbors(id)) {
+            EV_INFO << uint32ToIpv4(topologyTable.getAddress(neighbor)) << " ";
         }
         EV_INFO << endl;
     }
@@ -1201,9 +2180,32 @@ void Fsr::finish()
     EV_INFO << "HELLOs sent: " << numHellosSent << endl;
     EV_INFO << "Total packets received: " << numPacketsReceived << endl;
     EV_INFO << "Control bytes sent: " << controlBytesSent << endl;
+    EV_INFO << "Relays sent: " << numRelaysSent << ", suppressed: " << numRelaysSuppressed << endl;
+    EV_INFO << "SPF runs: " << numSpfRuns << " (avoided: " << numSpfAvoided << ")" << endl;
     EV_INFO << "Final neighbor count: " << neighbors.size() << endl;
 
     printTopologyTable();
+
+    // Per-node totals; per-packet and time series data come from the signals declared in Fsr.ned
+    recordScalar("controlBytesSent", controlBytesSent, "B");
+    recordScalar("topologyEntries", topologyTable.size());
+    recordScalar("topologyTableMemory", topologyTable.getMemoryUsage(), "B");
+    recordScalar("installedRoutes", installedRoutes.size());
+    if (multipath)
+        recordScalar("multipathSteered", numMultipathSteered);
+
+    if (!traceFile.empty() && trace.getTotalRecorded() > 0) {
+        // One file per node: "%s" in the pattern is replaced by the node name, otherwise it is appended
+        cModule *node = getContainingNode(this);
+        std::string fileName = traceFile;
+        size_t pos = fileName.find("%s");
+        if (pos != std::string::npos)
+            fileName.replace(pos, 2, node->getFullName());
+        else
+            fileName += std::string(".") + node->getFullName();
+        if (!trace.dump(fileName.c_str(), ipv4ToUint32(selfAddress), node->getFullName()))
+            EV_ERROR << "Cannot write FSR trace file " << fileName << endl;
+    }
 }
 
 } // namespace fsr
@@ -7,19 +7,29 @@
 #define INET_ROUTING_FSR_FSR_H_
 
 #include "inet/common/packet/Packet.h"
+#include "inet/common/Simsignals.h"
 #include "inet/networklayer/contract/IInterfaceTable.h"
 #include "inet/networklayer/contract/IRoutingTable.h"
 #include "inet/networklayer/contract/ipv4/Ipv4Address.h"
+#include "inet/networklayer/ipv4/Ipv4Header_m.h"
 #include "inet/networklayer/ipv4/Ipv4Route.h"
 #include "inet/networklayer/ipv4/Ipv4InterfaceData.h"
 #include "inet/networklayer/common/NetworkInterface.h"
+#include "inet/networklayer/base/NetfilterBase.h"
+#include "inet/networklayer/contract/INetfilter.h"
+#include "inet/queueing/contract/IPacketCollection.h"
 #include "inet/routing/base/RoutingProtocolBase.h"
 #include "inet/routing/fsr/FsrPacket_m.h"
+#include "inet/routing/fsr/FsrRoutingTable.h"
+#include "inet/routing/fsr/core/FsrLinkState.h"
+#include "inet/routing/fsr/FsrTrace.h"
 #include "inet/transportlayer/contract/udp/UdpSocket.h"
 #include "inet/common/Ptr.h"
 #include <cstdint>
 #include <set>
 #include <map>
+#include <queue>
+#include <string>
 #include <vector>
 
 namespace inet {
@@ -28,45 +38,84 @@ namespace fsr {
 /**
  * Fisheye State Routing (FSR) implementation for INET 4.x
  */
-class INET_API Fsr : public RoutingProtocolBase, public UdpSocket::ICallback
+class INET_API Fsr : public RoutingProtocolBase, public NetfilterBase::HookBase, public cListener, public UdpSocket::ICallback
 {
   protected:
-    // Topology table entry structure
-    struct tt_entry_t {
-        std::set<Ipv4Address> ls;  // Link state (neighbors)
-        uint32_t seq;              // Sequence number
-        uint32_t age;              // Age of entry
-    };
-
     // UDP socket for communication
     UdpSocket socket;
     cModule *host = nullptr;
 
     // Direct module pointers (instead of ModuleRefByPar)
     IRoutingTable *routingTable = nullptr;
+    FsrRoutingTable *batchRoutingTable = nullptr; // set if the routing table supports batched updates
     IInterfaceTable *interfaceTable = nullptr;
+    INetfilter *networkProtocol = nullptr;        // multipath only, its hooks spread flows over next hops
     bool socketInitialized = false;
 
     // Node's IP address
     Ipv4Address selfAddress;
     Ipv4Address primaryBroadcastAddress;
-    int outputInterfaceId = -1;
+    NetworkInterface *routeInterface = nullptr; // cached output interface for MANET routes
+    std::vector<NetworkInterface *> fsrInterfaces; // interfaces matching the interfaces parameter
+    bool spreadLsps = false;
+    size_t nextLspInterface = 0;        // spreadLsps: index of the interface of the next LSP broadcast
 
     // Timers
     cMessage *helloBroadcastTimer = nullptr;
     cMessage *lspUpdateTimer = nullptr;
-    cMessage *decrementAgeTimer = nullptr;
-    cMessage *lspLifeTimeTimer = nullptr;
+    cMessage *topologyExpiryTimer = nullptr; // fires at the earliest possible topology entry expiry
     cMessage *testTimer = nullptr;
+    cMessage *neighborExpiryTimer = nullptr; // fires at the earliest possible neighbor expiry
+    cMessage *lspAggregationTimer = nullptr; // end of the current LSP aggregation window
+    cMessage *spfTimer = nullptr;            // pending throttled SPF run
+    cMessage *loadSampleTimer = nullptr;
+    std::vector<cMessage *> scopeTimers; // one per fisheye scope
 
     // Configuration parameters
-    double lspUpdateInterval;
+    double lspUpdateInterval;           // current values, adapted to neighbor churn if adaptiveIntervals
     double helloBroadcastInterval;
-    double maxWaitTimeForLspAnnouncement;
     double maxJitter;
-    double lspLifeTimeInterval;
-    int lifeTime;
+    int lifeTime;                       // seconds an entry of another node lives without update
     int fsrPort;
+    bool incrementalRouteUpdate;
+    bool incrementalSpf;
+    bool fisheyeScoping;
+    std::vector<uint32_t> scopeRadii;
+    std::vector<double> scopeIntervalFactors;
+    std::vector<double> scopeIntervals; // scopeIntervalFactors x lspUpdateInterval
+    int lspFloodHopCount;
+    int maxLspPacketSize;
+    bool deltaLsp;
+    double lspFullRefreshInterval;
+    double lspAggregationWindow;
+    bool helloLinkState;
+    enum RelaySuppression { RELAY_ALWAYS, RELAY_COUNTER, RELAY_MPR };
+    RelaySuppression relaySuppression;
+    int relayCounterThreshold;
+    double relayJitter;
+    simtime_t spfInitialDelay;
+    simtime_t spfHoldTime;
+    simtime_t spfMaxHoldTime;
+    bool adaptiveIntervals;
+    double helloIntervalMin;
+    double helloIntervalMax;
+    double lspIntervalMin;
+    double lspIntervalMax;
+    int intervalChurnThreshold;
+    enum RoutingMetric { METRIC_HOP_COUNT, METRIC_ETX };
+    RoutingMetric routingMetric;
+    double etxWindow;                   // HELLOs the delivery ratio estimate averages over
+    double etxChangeThreshold;          // relative link cost change that is advertised
+    bool multipath;
+    int maxMultipathNextHops;
+    bool loadAwareRouting;
+    double loadSampleInterval;
+    int loadQueueLength;                // packets that count as full for a queue without limit
+    double loadDropRate;                // MAC drops per second that count as saturated
+    double loadSmoothing;
+    int loadLevels;
+    double loadHysteresis;
+    double loadPenalty;                 // in hops or ETX
 
     // Statistics
     uint32_t controlBytesSent;
@@ -74,14 +123,121 @@ class INET_API Fsr : public RoutingProtocolBase, public UdpSocket::ICallback
     uint32_t numLSPsReceived;
     uint32_t numHellosSent;
     uint32_t numPacketsReceived;
+    uint32_t numRelaysSent;
+    uint32_t numRelaysSuppressed;
+    uint32_t numSpfRuns;
+    uint32_t numSpfAvoided;
+    uint32_t numMultipathSteered;       // datagrams sent to another than the routing table's next hop
+    static simsignal_t helloSentSignal;       // bytes of each sent packet, per type
+    static simsignal_t lspSentSignal;
+    static simsignal_t lspRequestSentSignal;
+    static simsignal_t controlSentSignal;     // bytes of every sent FSR packet
+    static simsignal_t helloReceivedSignal;   // bytes of each received packet, per type
+    static simsignal_t lspReceivedSignal;
+    static simsignal_t lspDuplicateSignal;    // received entries not newer than the stored one
+    static simsignal_t lspRelayedSignal;
+    static simsignal_t relaySuppressedSignal;
+    static simsignal_t spfRunSignal;          // destinations recomputed by each run
+    static simsignal_t spfAvoidedSignal;
+    static simsignal_t routesAddedSignal;     // route churn of each SPF run
+    static simsignal_t routesChangedSignal;
+    static simsignal_t routesDeletedSignal;
+    static simsignal_t topologySizeSignal;    // nodes with a topology entry
+    static simsignal_t neighborCountSignal;
+    static simsignal_t helloIntervalSignal;   // interval chosen by the adaptive controller
+    static simsignal_t lspIntervalSignal;
+    static simsignal_t loadLevelSignal;       // own advertised load level
+
+    // Binary event trace, see FsrTrace.h
+    FsrTraceBuffer trace;
+    std::string traceFile;
 
     // FSR data structures
-    std::map<Ipv4Address, cMessage *> neighborTimeouts;
-    std::map<Ipv4Address, tt_entry_t> topologyTable;
-    std::map<Ipv4Address, uint32_t> distanceTable;
-    std::map<Ipv4Address, int> lifetimeTable;
+    // One interface a neighbor is heard on
+    struct NeighborLink {
+        int interfaceId;
+        Ipv4Address address;    // the neighbor's own address on that interface, the gateway of routes over it
+        simtime_t lastHeard;
+    };
+    // Neighbor liveness: HELLOs only move lastHeard, the expiry queue holds one entry per
+    // neighbor and is re-armed lazily when that entry comes due
+    struct NeighborState {
+        simtime_t lastHeard;
+        simtime_t queuedExpiry; // expiry of this neighbor's live queue entry
+        simtime_t holdTime;     // as advertised in its last HELLO
+        std::vector<NeighborLink> links; // in order of discovery, routes use the first
+        std::vector<uint32_t> neighbors; // its 1-hop neighbors as advertised (MPR mode)
+        bool mprSelector = false;        // it selected this node as multipoint relay
+        // ETX metric: delivery ratios of its HELLOs to us (measured) and of ours to it (reported)
+        uint32_t lastHelloSeq = 0;
+        double reverseRatio = 1;
+        double forwardRatio = -1;        // not reported yet
+        FsrTopologyTable::LinkCost linkCost = FsrTopologyTable::UNIT_COST; // as in the own entry
+    };
+    struct NeighborExpiry {
+        simtime_t expiry;
+        Ipv4Address neighbor;
+        bool operator>(const NeighborExpiry &other) const { return expiry > other.expiry; }
+    };
+    std::map<Ipv4Address, NeighborState> neighborStates;  // keyed by router id
+    std::map<Ipv4Address, Ipv4Address> linkNeighbors;    // neighbor interface address -> its router id
+    std::priority_queue<NeighborExpiry, std::vector<NeighborExpiry>, std::greater<NeighborExpiry>> neighborExpiryQueue;
+    simtime_t neighborHoldTime;         // advertised in own HELLOs, and used for neighbors that advertise none
+    // Adaptive intervals: churn since the last HELLO, and the last change and backoff of each interval
+    uint32_t neighborChanges = 0;
+    simtime_t lastNeighborChange;
+    simtime_t lastHelloBackoff;
+    simtime_t lastLspBackoff;
+    FsrLinkState linkState;             // simulator-independent protocol core, all table updates go through it
+    const FsrTopologyTable &topologyTable = linkState.getTable(); // link state per node, keyed by dense id
+    const FsrSpf &spf = linkState.getSpf();                      // shortest paths from this node
+    uint32_t selfId = FsrTopologyTable::NO_ID;
+    std::vector<uint32_t> lsScratch;    // reused neighbor id buffer
+    std::vector<FsrTopologyTable::LinkCost> lsCostScratch;
+    std::vector<std::pair<uint32_t, FsrTopologyTable::LinkCost>> lsLinkScratch;
+    // Topology expiry: one queue entry per live table entry, re-armed lazily from its update time
+    struct TopologyExpiry {
+        simtime_t expiry;
+        uint32_t id;
+        bool operator>(const TopologyExpiry &other) const { return expiry > other.expiry; }
+    };
+    std::priority_queue<TopologyExpiry, std::vector<TopologyExpiry>, std::greater<TopologyExpiry>> topologyExpiryQueue;
+    std::vector<simtime_t> queuedTopologyExpiry; // per id, expiry of its live queue entry or zero
     std::set<Ipv4Address> neighbors;
+    std::set<Ipv4Address> mprs;         // neighbors selected to relay our floods (MPR mode)
+    // Originated and relayed entries waiting for the aggregation window to close, one per originator
+    struct PendingLsp {
+        uint8_t hopCount;
+        LspEntry entry;
+        bool relayed;  // received from another node, may be suppressed
+        int copies;    // copies of this version heard while pending (counter mode)
+    };
+    std::map<uint32_t, PendingLsp> pendingLsps;
+    std::vector<uint32_t> lspRequests;  // addresses of nodes whose full entry is requested
+    std::vector<simtime_t> lspRequestHoldoff; // per node id, no new request before this time
+    // MPR mode duplicate set: per node id, the version last relayed, like OLSR's retransmitted flag
+    static constexpr uint32_t NOT_RELAYED = UINT32_MAX;
+    std::vector<uint32_t> relayedSeqs;
+    std::vector<unsigned int> lateRelays;     // stale entries of the current packet still to relay
+    std::vector<simtime_t> nextFullRefresh;   // per scope (index 0 when flooding)
+    std::vector<uint32_t> advertisedOwnNeighbors; // own neighbor ids as last sent
+    std::vector<FsrTopologyTable::LinkCost> advertisedOwnCosts; // and their costs (ETX metric)
+    uint32_t advertisedOwnSeq = 0;
+    bool ownEntryAdvertised = false;
+    simtime_t nextNearRefresh;          // combined mode: the HELLO sent from then on carries the near-scope update
+    std::vector<uint32_t> spfChanged;   // destinations touched by the last incremental SPF run
+    std::map<uint32_t, std::vector<uint32_t>> multipathNextHops; // per destination id, filled on demand, cleared by every SPF run
+    simtime_t lastSpfRun;
+    simtime_t spfCurrentHold;           // grows while changes keep coming, see scheduleSpf()
+    std::map<Ipv4Address, Ipv4Route *> installedRoutes; // MANET routes currently owned by FSR
+    bool routesLost = false;            // the routing table deleted installed routes, the next SPF run revisits every destination
     uint32_t sequenceNumber;
+    uint32_t helloSequenceNumber;       // HELLOs are numbered separately, receivers count the gaps
+    // Congestion-aware routing: MAC queues of the FSR interfaces, drops counted since the last sample
+    std::vector<queueing::IPacketCollection *> loadQueues;
+    uint32_t macDrops = 0;
+    double loadAverage = 0;
+    int loadLevel = 0;                  // 0 .. loadLevels - 1, advertised as load 0 .. 255
 
   protected:
     virtual int numInitStages() const override { return NUM_INIT_STAGES; }
@@ -93,32 +249,88 @@ class INET_API Fsr : public RoutingProtocolBase, public UdpSocket::ICallback
     virtual void handleStopOperation(LifecycleOperation *operation) override;
     virtual void handleCrashOperation(LifecycleOperation *operation) override;
 
+    // Netfilter hooks: with multipath, unicast datagrams to FSR destinations are spread over equal-cost next hops
+    virtual Result datagramPreRoutingHook(Packet *datagram) override;
+    virtual Result datagramForwardHook(Packet *datagram) override { return ACCEPT; }
+    virtual Result datagramPostRoutingHook(Packet *datagram) override { return ACCEPT; }
+    virtual Result datagramLocalInHook(Packet *datagram) override { return ACCEPT; }
+    virtual Result datagramLocalOutHook(Packet *datagram) override;
+    Result spreadFlow(Packet *datagram);
+    uint32_t getFlowHash(Packet *datagram, const Ipv4Header &ipv4Header) const;
+
+    // Congestion-aware routing: MAC drops of the FSR interfaces
+    virtual void receiveSignal(cComponent *source, simsignal_t signalID, cObject *obj, cObject *details) override;
+    void resolveLoadSources();
+    void sampleLoad();
+    uint8_t getOwnLoad() const;
+
     // UDP callback interface
     virtual void socketDataArrived(UdpSocket *socket, Packet *packet) override;
     virtual void socketErrorArrived(UdpSocket *socket, Indication *indication) override;
     virtual void socketClosed(UdpSocket *socket) override;
 
     // FSR protocol functions
-    void processFsrPacket(const Ptr<const FsrPacket> &packet, const L3Address &sourceAddr);
-    void processLSP(const Ptr<const FsrPacket> &packet, const Ipv4Address &sourceAddr);
-    void processHello(const Ptr<const FsrPacket> &packet, const Ipv4Address &sourceAddr);
+    void processFsrPacket(const Ptr<const FsrPacket> &packet, uint8_t hopCount, const L3Address &sourceAddr, int interfaceId);
+    void processLSP(const Ptr<const FsrPacket> &packet, uint8_t hopCount, const Ipv4Address &neighbor, const NeighborLink &link);
+    void processHello(const Ptr<const FsrPacket> &packet, const NeighborLink &link);
+    void processLspRequest(const Ptr<const FsrPacket> &packet, const NeighborLink &link);
+    void sendLspRequest(const NeighborLink &link);
     void calculateShortestPath();
+    void scheduleSpf();
+    void runScheduledSpf();
     void sendTopologyUpdate();
-    void updateRoutes(std::map<Ipv4Address, Ipv4Address> &prev);
+    void sendScopeUpdate(int scope);
+    void scheduleScopeTimers();
+    bool isNearLspMerged() const;
+    void piggybackLinkState(const Ptr<FsrPacket> &hello);
+    int getScope(uint32_t id) const;
+    void fillLspEntry(LspEntry &entry, uint32_t id, bool full);
+    bool isFullRefreshDue(int index);
+    void appendLspEntry(Ptr<FsrPacket> &fsrchunk, const LspEntry &entry, const Ipv4Address &destAddr, uint8_t hopCount = 1, int interfaceId = -1);
+    void flushLspPacket(Ptr<FsrPacket> &fsrchunk, const Ipv4Address &destAddr, uint8_t hopCount = 1, int interfaceId = -1);
+    void queueLspEntry(const LspEntry &entry, uint8_t hopCount, bool relayed);
+    bool isRelayAllowed(const Ipv4Address &sender) const;
+    bool isRelayed(uint32_t id, uint32_t seq) const;
+    void markRelayed(uint32_t id, uint32_t seq);
+    void countRelaySuppressed();
+    void countRelaySent();
+    void computeMprs();
+    void sendPendingLsps();
+    void updateRoutes(const std::vector<uint32_t> *changedIds = nullptr);
+    void updateRoute(uint32_t index, int &added, int &changed, int &deleted);
+    void setTopologyEntry(uint32_t id, uint32_t seq, std::vector<uint32_t> &neighborIds, std::vector<FsrTopologyTable::LinkCost> *costs = nullptr);
+    void removeTopologyEntry(uint32_t id);
+    void armTopologyExpiry(uint32_t id);
     void initNode();
-    void decrementAge();
+    void updateOwnEntry();
+    void expireTopology();
 
     // Helper functions
     void sendMessageToNeighbors(const Ptr<FsrPacket> &payload);
     void sendHelloPacket();
-    void createRoute(const Ipv4Address &dst, const Ipv4Address &nexthop, uint32_t hopCount);
+    Ipv4Route *createRoute(const Ipv4Address &dst, const Ipv4Address &nexthop, uint32_t metric, NetworkInterface *ie);
     void clearRoutes();
+    NetworkInterface *getRouteInterface();
+    void resolveInterfaces();
+    bool isFsrInterface(int interfaceId) const;
+    const NeighborLink *findRouteLink(const Ipv4Address &neighbor) const;
     void printTopologyTable();
     void removeNeighbor(const Ipv4Address &neighbor);
-    void addNeighbor(const Ipv4Address &neighbor);
-    void sendFsrPacketHelper(const Ptr<FsrPacket> &fsrPacket, const Ipv4Address &destAddr);
-    Ptr<FsrPacket> deserializeFsrPacket(const Ptr<const BytesChunk> &bytesChunk);
-    std::vector<uint8_t> serializeFsrPacket(const Ptr<FsrPacket> &fsrPacket);
+    void addNeighbor(const Ipv4Address &neighbor, simtime_t holdTime, const NeighborLink &link);
+    void pruneNeighborLinks(const Ipv4Address &neighbor, NeighborState &state, simtime_t now);
+    void queueNeighborExpiry(const Ipv4Address &neighbor, NeighborState &state, simtime_t expiry);
+    void noteNeighborChange();
+    void updateLinkQuality(const Ipv4Address &neighbor, const Ptr<const FsrPacket> &hello);
+    FsrTopologyTable::LinkCost computeLinkCost(const NeighborState &state) const;
+    void adaptIntervals();
+    void resetIntervals();
+    void setHelloInterval(double interval);
+    void setLspInterval(double interval);
+    void expireNeighbors();
+    void clearNeighbors();
+    void sendFsrPacketHelper(const Ptr<FsrPacket> &fsrPacket, const Ipv4Address &destAddr, uint8_t hopCount = 1, int interfaceId = -1);
+    void sendFsrPacket(const Ptr<const FsrPacket> &fsrPacket, uint8_t hopCount, const Ipv4Address &destAddr, int interfaceId = -1);
+    void sendFsrPacketOnInterface(const Ptr<const FsrPacket> &fsrPacket, uint8_t hopCount, const Ipv4Address &destAddr, int interfaceId);
     Ipv4Address getRouterId();
 
     // Debugging functions
@@ -0,0 +1,290 @@
+/*
+ * FsrConvergenceObserver.cc
+ * Network-level measurement of FSR routing convergence
+ */
+
+#include "inet/routing/fsr/FsrConvergenceObserver.h"
+
+#include "inet/common/ModuleAccess.h"
+#include "inet/common/Simsignals.h"
+#include "inet/networklayer/ipv4/Ipv4InterfaceData.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace inet {
+namespace fsr {
+
+Define_Module(FsrConvergenceObserver);
+
+simsignal_t FsrConvergenceObserver::topologyChangeSignal = registerSignal("topologyChange");
+simsignal_t FsrConvergenceObserver::routeCorrectnessSignal = registerSignal("routeCorrectness");
+simsignal_t FsrConvergenceObserver::loopPairsSignal = registerSignal("loopPairs");
+simsignal_t FsrConvergenceObserver::blackHolePairsSignal = registerSignal("blackHolePairs");
+simsignal_t FsrConvergenceObserver::convergenceTimeSignal = registerSignal("convergenceTime");
+
+FsrConvergenceObserver::~FsrConvergenceObserver()
+{
+    cancelAndDelete(sampleTimer);
+}
+
+void FsrConvergenceObserver::initialize(int stage)
+{
+    cSimpleModule::initialize(stage);
+
+    if (stage == INITSTAGE_LOCAL) {
+        communicationRange = par("communicationRange");
+        sampleInterval = par("sampleInterval").doubleValue();
+        if (communicationRange <= 0 || sampleInterval <= 0)
+            throw cRuntimeError("communicationRange and sampleInterval must be positive");
+        sampleTimer = new cMessage("sampleTimer");
+    }
+    else if (stage == INITSTAGE_LAST) {
+        // Addresses are assigned by now
+        resolveNodes();
+        cModule *network = getParentModule();
+        network->subscribe(routeAddedSignal, this);
+        network->subscribe(routeDeletedSignal, this);
+        network->subscribe(routeChangedSignal, this);
+        scheduleAt(simTime(), sampleTimer);
+    }
+}
+
+void FsrConvergenceObserver::resolveNodes()
+{
+    cModule *network = getParentModule();
+    const char *vectorName = par("nodeVector");
+    int numNodes = network->getSubmoduleVectorSize(vectorName);
+    if (numNodes >= NO_NODE)
+        throw cRuntimeError("Too many nodes to observe (%d)", numNodes);
+
+    nodes.resize(numNodes);
+    for (int i = 0; i < numNodes; i++) {
+        Node &node = nodes[i];
+        node.module = network->getSubmodule(vectorName, i);
+        node.mobility = check_and_cast<IMobility *>(node.module->getSubmodule("mobility"));
+        node.routingTable = check_and_cast<IRoutingTable *>(node.module->getModuleByPath(".ipv4.routingTable"));
+        // Routes name a node by its router id and a gateway by its address on the shared interface, any may occur
+        IInterfaceTable *interfaceTable = check_and_cast<IInterfaceTable *>(node.module->getSubmodule("interfaceTable"));
+        for (int j = 0; j < interfaceTable->getNumInterfaces(); j++) {
+            NetworkInterface *ie = interfaceTable->getInterface(j);
+            auto ipv4Data = ie->findProtocolData<Ipv4InterfaceData>();
+            if (!ie->isLoopback() && ipv4Data && !ipv4Data->getIPAddress().isUnspecified()) {
+                if (node.address == 0)
+                    node.address = ipv4Data->getIPAddress().getInt();
+                indexOfAddress[ipv4Data->getIPAddress().getInt()] = i;
+            }
+        }
+        indexOfModule[node.module->getId()] = i;
+    }
+
+    routesDirty.assign(numNodes, 1);
+    nextHop.assign((size_t)numNodes * numNodes, NO_NODE);
+    walkState.resize(numNodes);
+}
+
+void FsrConvergenceObserver::handleMessage(cMessage *msg)
+{
+    if (msg != sampleTimer)
+        throw cRuntimeError("Unexpected message %s", msg->getName());
+    sample();
+    scheduleAfter(sampleInterval, sampleTimer);
+}
+
+void FsrConvergenceObserver::receiveSignal(cComponent *source, simsignal_t signalID, cObject *obj, cObject *details)
+{
+    // Route added, deleted or changed in some node: re-read its routes at the next sample
+    cModule *node = findContainingNode(check_and_cast<cModule *>(source));
+    if (!node)
+        return;
+    auto it = indexOfModule.find(node->getId());
+    if (it != indexOfModule.end()) {
+        routesDirty[it->second] = 1;
+        anyRoutesDirty = true;
+    }
+}
+
+void FsrConvergenceObserver::sample()
+{
+    int changedLinks = updateTopology();
+    if (changedLinks > 0) {
+        emit(topologyChangeSignal, (long)changedLinks);
+        lastTopologyChange = simTime();
+        converged = false;
+        computeDistances();
+    }
+    else if (!anyRoutesDirty)
+        return; // Nothing to re-evaluate
+
+    for (uint16_t i = 0; i < nodes.size(); i++) {
+        if (routesDirty[i])
+            readRoutes(i);
+    }
+    anyRoutesDirty = false;
+    evaluate();
+}
+
+int FsrConvergenceObserver::updateTopology()
+{
+    // Unit-disk graph, candidate pairs found through a grid of communicationRange sized cells
+    uint16_t n = nodes.size();
+    std::vector<Coord> positions(n);
+    std::unordered_map<int64_t, std::vector<uint16_t>> cells;
+    auto cellKey = [](int64_t x, int64_t y) { return (x << 32) ^ (y & 0xFFFFFFFF); };
+    for (uint16_t i = 0; i < n; i++) {
+        positions[i] = nodes[i].mobility->getCurrentPosition();
+        cells[cellKey((int64_t)std::floor(positions[i].x / communicationRange), (int64_t)std::floor(positions[i].y / communicationRange))].push_back(i);
+    }
+
+    std::vector<std::vector<uint16_t>> newAdjacency(n);
+    double rangeSquared = communicationRange * communicationRange;
+    for (uint16_t i = 0; i < n; i++) {
+        int64_t cx = (int64_t)std::floor(positions[i].x / communicationRange);
+        int64_t cy = (int64_t)std::floor(positions[i].y / communicationRange);
+        for (int64_t dx = -1; dx <= 1; dx++) {
+            for (int64_t dy = -1; dy <= 1; dy++) {
+                auto cell = cells.find(cellKey(cx + dx, cy + dy));
+                if (cell == cells.end())
+                    continue;
+                for (uint16_t j : cell->second) {
+                    if (j != i && positions[i].sqrdist(positions[j]) <= rangeSquared)
+                        newAdjacency[i].push_back(j);
+                }
+            }
+        }
+        std::sort(newAdjacency[i].begin(), newAdjacency[i].end());
+    }
+
+    // Links that appeared or disappeared, each counted from both ends
+    int changed = 0;
+    if (adjacency.size() != n)
+        adjacency.resize(n);
+    for (uint16_t i = 0; i < n; i++) {
+        const auto &before = adjacency[i], &after = newAdjacency[i];
+        std::vector<uint16_t> difference;
+        std::set_symmetric_difference(before.begin(), before.end(), after.begin(), after.end(), std::back_inserter(difference));
+        changed += difference.size();
+    }
+    adjacency.swap(newAdjacency);
+    return changed / 2;
+}
+
+void FsrConvergenceObserver::computeDistances()
+{
+    // BFS from every destination; links are symmetric, so this is also the distance towards it
+    size_t n = nodes.size();
+    distance.assign(n * n, UNREACHABLE);
+    std::vector<uint16_t> queue;
+    queue.reserve(n);
+    for (size_t d = 0; d < n; d++) {
+        uint16_t *dist = &distance[d * n];
+        queue.clear();
+        queue.push_back(d);
+        dist[d] = 0;
+        for (size_t head = 0; head < queue.size(); head++) {
+            uint16_t u = queue[head];
+            for (uint16_t v : adjacency[u]) {
+                if (dist[v] == UNREACHABLE) {
+                    dist[v] = dist[u] + 1;
+                    queue.push_back(v);
+                }
+            }
+        }
+    }
+}
+
+void FsrConvergenceObserver::readRoutes(uint16_t index)
+{
+    size_t n = nodes.size();
+    uint16_t *hops = &nextHop[index * n];
+    std::fill(hops, hops + n, NO_NODE);
+    IRoutingTable *routingTable = nodes[index].routingTable;
+    for (int i = 0; i < routingTable->getNumRoutes(); i++) {
+        IRoute *route = routingTable->getRoute(i);
+        if (route->getSourceType() != IRoute::MANET)
+            continue;
+        auto dest = indexOfAddress.find(route->getDestinationAsGeneric().toIpv4().getInt());
+        if (dest == indexOfAddress.end())
+            continue;
+        Ipv4Address gateway = route->getNextHopAsGeneric().toIpv4();
+        if (gateway.isUnspecified())
+            hops[dest->second] = dest->second;
+        else {
+            auto hop = indexOfAddress.find(gateway.getInt());
+            if (hop != indexOfAddress.end())
+                hops[dest->second] = hop->second;
+        }
+    }
+    routesDirty[index] = 0;
+}
+
+bool FsrConvergenceObserver::isTrueNeighbor(uint16_t from, uint16_t to) const
+{
+    return std::binary_search(adjacency[from].begin(), adjacency[from].end(), to);
+}
+
+void FsrConvergenceObserver::evaluate()
+{
+    enum { UNKNOWN, ON_PATH, DELIVERED, BLACK_HOLE, LOOP };
+    size_t n = nodes.size();
+    long pairs = 0, correct = 0, loops = 0, blackHoles = 0;
+    for (uint16_t d = 0; d < n; d++) {
+        const uint16_t *dist = &distance[(size_t)d * n];
+        std::fill(walkState.begin(), walkState.end(), UNKNOWN);
+        walkState[d] = DELIVERED;
+        for (uint16_t s = 0; s < n; s++) {
+            if (s == d || dist[s] == UNREACHABLE)
+                continue;
+            pairs++;
+            uint16_t hop = nextHop[(size_t)s * n + d];
+            if (hop != NO_NODE && isTrueNeighbor(s, hop) && dist[hop] + 1 == dist[s])
+                correct++;
+
+            // Follow the installed next hops; every node on the walk shares its outcome
+            walkPath.clear();
+            uint16_t current = s;
+            uint8_t outcome;
+            while (true) {
+                if (walkState[current] == ON_PATH) {
+                    outcome = LOOP;
+                    break;
+                }
+                if (walkState[current] != UNKNOWN) {
+                    outcome = walkState[current];
+                    break;
+                }
+                walkState[current] = ON_PATH;
+                walkPath.push_back(current);
+                uint16_t next = nextHop[(size_t)current * n + d];
+                if (next == NO_NODE || !isTrueNeighbor(current, next)) {
+                    outcome = BLACK_HOLE;
+                    break;
+                }
+                current = next;
+            }
+            for (uint16_t visited : walkPath)
+                walkState[visited] = outcome;
+            if (outcome == LOOP)
+                loops++;
+            else if (outcome == BLACK_HOLE)
+                blackHoles++;
+        }
+    }
+
+    emit(routeCorrectnessSignal, pairs > 0 ? (double)correct / pairs : 1.0);
+    emit(loopPairsSignal, loops);
+    emit(blackHolePairsSignal, blackHoles);
+    if (!converged && correct == pairs && loops == 0 && blackHoles == 0) {
+        converged = true;
+        emit(convergenceTimeSignal, simTime() - lastTopologyChange);
+    }
+}
+
+void FsrConvergenceObserver::finish()
+{
+    recordScalar("converged", converged);
+    recordScalar("lastTopologyChange", lastTopologyChange.dbl(), "s");
+}
+
+} // namespace fsr
+} // namespace inet
@@ -0,0 +1,97 @@
+/*
+ * FsrConvergenceObserver.h
+ * Network-level measurement of FSR routing convergence
+ */
+
+#ifndef INET_ROUTING_FSR_FSRCONVERGENCEOBSERVER_H_
+#define INET_ROUTING_FSR_FSRCONVERGENCEOBSERVER_H_
+
+#include "inet/common/INETDefs.h"
+#include "inet/mobility/contract/IMobility.h"
+#include "inet/networklayer/contract/IInterfaceTable.h"
+#include "inet/networklayer/contract/IRoutingTable.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace inet {
+namespace fsr {
+
+/**
+ * Compares the MANET routes installed in every node with ground truth.
+ *
+ * The true topology is the unit-disk graph of the node positions at
+ * communicationRange. Every sampleInterval the observer rebuilds it and
+ * notes a topology change if any link differs. Installed routes are then
+ * checked against shortest-path next hops.
+ *
+ * Work is limited to what changed. The all-destination BFS runs only
+ * after a topology change. A node's routes are re-read only after its
+ * routing table signalled a change. Forwarding chains are re-walked only
+ * when either happened.
+ *
+ * A sample in which every reachable pair has a shortest-path next hop,
+ * and no chain loops or ends in a black hole, ends the convergence period
+ * started by the last topology change.
+ */
+class INET_API FsrConvergenceObserver : public cSimpleModule, public cListener
+{
+  protected:
+    static constexpr uint16_t NO_NODE = UINT16_MAX;
+    static constexpr uint16_t UNREACHABLE = UINT16_MAX;
+
+    struct Node {
+        cModule *module = nullptr;
+        IMobility *mobility = nullptr;
+        IRoutingTable *routingTable = nullptr;
+        uint32_t address = 0;
+    };
+
+    // Parameters
+    double communicationRange;
+    simtime_t sampleInterval;
+    cMessage *sampleTimer = nullptr;
+
+    std::vector<Node> nodes;
+    std::unordered_map<uint32_t, uint16_t> indexOfAddress;
+    std::unordered_map<int, uint16_t> indexOfModule;   // node module id
+    std::vector<std::vector<uint16_t>> adjacency;      // ground truth, sorted
+    std::vector<uint16_t> distance;                    // hop distance, [destination * n + node]
+    std::vector<uint16_t> nextHop;                     // installed next hop, [node * n + destination]
+    std::vector<uint8_t> routesDirty;                  // routing table changed since last read
+    bool anyRoutesDirty = true;
+    std::vector<uint8_t> walkState;
+    std::vector<uint16_t> walkPath;
+
+    simtime_t lastTopologyChange;
+    bool converged = false;
+
+    static simsignal_t topologyChangeSignal;
+    static simsignal_t routeCorrectnessSignal;
+    static simsignal_t loopPairsSignal;
+    static simsignal_t blackHolePairsSignal;
+    static simsignal_t convergenceTimeSignal;
+
+  protected:
+    virtual int numInitStages() const override { return NUM_INIT_STAGES; }
+    virtual void initialize(int stage) override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    virtual void receiveSignal(cComponent *source, simsignal_t signalID, cObject *obj, cObject *details) override;
+
+    void resolveNodes();
+    void sample();
+    int updateTopology();
+    void computeDistances();
+    void readRoutes(uint16_t index);
+    void evaluate();
+    bool isTrueNeighbor(uint16_t from, uint16_t to) const;
+
+  public:
+    virtual ~FsrConvergenceObserver() override;
+};
+
+} // namespace fsr
+} // namespace inet
+
+#endif /* INET_ROUTING_FSR_FSRCONVERGENCEOBSERVER_H_ */
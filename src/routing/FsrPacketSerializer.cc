@@ -0,0 +1,80 @@
+/*
+ * FsrPacketSerializer.cc
+ * Wire format of FSR packets
+ */
+
+#include "inet/routing/fsr/FsrPacketSerializer.h"
+
+#include "inet/common/packet/serializer/ChunkSerializerRegistry.h"
+
+namespace inet {
+namespace fsr {
+
+Register_Serializer(FsrPacket, FsrPacketSerializer);
+Register_Serializer(FsrRelayHeader, FsrRelayHeaderSerializer);
+
+const B FsrPacketSerializer::FSR_HEADER_LENGTH = B(FsrWireCodec::HEADER_LENGTH);
+const B FsrPacketSerializer::LSP_ENTRY_HEADER_LENGTH = B(FsrWireCodec::ENTRY_HEADER_LENGTH);
+const B FsrPacketSerializer::LSP_DELTA_HEADER_LENGTH = B(FsrWireCodec::DELTA_HEADER_LENGTH);
+
+namespace {
+
+// MemoryInputStream as FsrWireCodec::read() expects it, with the remaining length in bytes
+struct FsrInputStream
+{
+    MemoryInputStream& stream;
+
+    uint8_t readUint8() { return stream.readUint8(); }
+    uint16_t readUint16Be() { return stream.readUint16Be(); }
+    uint32_t readUint32Be() { return stream.readUint32Be(); }
+    bool isReadBeyondEnd() const { return stream.isReadBeyondEnd(); }
+    size_t getRemainingBytes() const { return B(stream.getRemainingLength()).get(); }
+};
+
+} // namespace
+
+B FsrPacketSerializer::getSerializedLength(const FsrPacket& fsrPacket)
+{
+    return B(FsrWireCodec::getLength(fsrPacket));
+}
+
+B FsrPacketSerializer::getSerializedLength(const LspEntry& entry)
+{
+    return B(FsrWireCodec::getEntryLength(entry));
+}
+
+void FsrPacketSerializer::serialize(MemoryOutputStream& stream, const Ptr<const Chunk>& chunk) const
+{
+    // Only reached when the stack needs actual bytes, FsrPacket chunks normally travel as fields
+    const auto& fsrPacket = staticPtrCast<const FsrPacket>(chunk);
+    if (const char *list = FsrWireCodec::findOverlongList(*fsrPacket))
+        throw cRuntimeError("FsrPacket %s list too long for its count field", list);
+    FsrWireCodec::write(*fsrPacket, stream);
+}
+
+const Ptr<Chunk> FsrPacketSerializer::deserialize(MemoryInputStream& stream) const
+{
+    auto fsrPacket = makeShared<FsrPacket>();
+    FsrInputStream input{stream};
+    if (!FsrWireCodec::read(input, *fsrPacket))
+        fsrPacket->markIncorrect();
+    fsrPacket->setTimestamp(simTime().dbl()); // not transmitted
+    fsrPacket->setChunkLength(getSerializedLength(*fsrPacket));
+    return fsrPacket;
+}
+
+void FsrRelayHeaderSerializer::serialize(MemoryOutputStream& stream, const Ptr<const Chunk>& chunk) const
+{
+    const auto& relayHeader = staticPtrCast<const FsrRelayHeader>(chunk);
+    stream.writeUint8(relayHeader->getHopCount());
+}
+
+const Ptr<Chunk> FsrRelayHeaderSerializer::deserialize(MemoryInputStream& stream) const
+{
+    auto relayHeader = makeShared<FsrRelayHeader>();
+    relayHeader->setHopCount(stream.readUint8());
+    return relayHeader;
+}
+
+} // namespace fsr
+} // namespace inet
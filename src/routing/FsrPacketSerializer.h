@@ -0,0 +1,59 @@
+/*
+ * FsrPacketSerializer.h
+ * Wire format of FSR packets
+ */
+
+#ifndef INET_ROUTING_FSR_FSRPACKETSERIALIZER_H_
+#define INET_ROUTING_FSR_FSRPACKETSERIALIZER_H_
+
+#include "inet/common/packet/serializer/FieldsChunkSerializer.h"
+#include "inet/routing/fsr/FsrPacket_m.h"
+#include "inet/routing/fsr/core/FsrWire.h"
+
+namespace inet {
+namespace fsr {
+
+/**
+ * Converts between FsrPacket and the wire format of FsrWireCodec.
+ *
+ * Packets travel as FieldsChunks and are only serialized when the stack
+ * actually needs their bytes. Fields are then written to and read from
+ * the stream directly by FsrWireCodec::write() and read(), the same code
+ * that encodes plain buffers for the standalone tools.
+ */
+class INET_API FsrPacketSerializer : public FieldsChunkSerializer
+{
+  public:
+    static const B FSR_HEADER_LENGTH;
+    static const B LSP_ENTRY_HEADER_LENGTH;
+    static const B LSP_DELTA_HEADER_LENGTH;
+
+    /** Exact length of the serialized form, used as chunk length. */
+    static B getSerializedLength(const FsrPacket& fsrPacket);
+    static B getSerializedLength(const LspEntry& entry);
+
+  protected:
+    virtual void serialize(MemoryOutputStream& stream, const Ptr<const Chunk>& chunk) const override;
+    virtual const Ptr<Chunk> deserialize(MemoryInputStream& stream) const override;
+
+  public:
+    FsrPacketSerializer() : FieldsChunkSerializer() {}
+};
+
+/**
+ * Converts between FsrRelayHeader and its wire format: hopCount(1).
+ */
+class INET_API FsrRelayHeaderSerializer : public FieldsChunkSerializer
+{
+  protected:
+    virtual void serialize(MemoryOutputStream& stream, const Ptr<const Chunk>& chunk) const override;
+    virtual const Ptr<Chunk> deserialize(MemoryInputStream& stream) const override;
+
+  public:
+    FsrRelayHeaderSerializer() : FieldsChunkSerializer() {}
+};
+
+} // namespace fsr
+} // namespace inet
+
+#endif /* INET_ROUTING_FSR_FSRPACKETSERIALIZER_H_ */
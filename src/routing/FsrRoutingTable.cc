@@ -0,0 +1,120 @@
+/*
+ * FsrRoutingTable.cc
+ * IPv4 routing table with batched updates
+ */
+
+#include "inet/routing/fsr/FsrRoutingTable.h"
+
+#include "inet/common/Simsignals.h"
+
+#include <algorithm>
+
+namespace inet {
+namespace fsr {
+
+Define_Module(FsrRoutingTable);
+
+FsrRoutingTable::~FsrRoutingTable()
+{
+    for (auto& pending : pendingChanges) {
+        if (pending.second == PENDING_DELETED)
+            delete pending.first;
+    }
+}
+
+void FsrRoutingTable::invalidateCache()
+{
+    if (batchDepth > 0)
+        cacheInvalidationPending = true;
+    else
+        Ipv4RoutingTable::invalidateCache();
+}
+
+void FsrRoutingTable::addRoute(Ipv4Route *entry)
+{
+    if (batchDepth == 0) {
+        Ipv4RoutingTable::addRoute(entry);
+        return;
+    }
+    Enter_Method("addRoute(...)");
+    internalAddRoute(entry);
+    cacheInvalidationPending = true;
+    pendingRoutes.push_back(entry);
+    pendingChanges[entry] = PENDING_ADDED;
+}
+
+bool FsrRoutingTable::deleteRoute(Ipv4Route *entry)
+{
+    if (batchDepth == 0)
+        return Ipv4RoutingTable::deleteRoute(entry);
+    Enter_Method("deleteRoute(...)");
+    if (!internalRemoveRoute(entry))
+        return false;
+    cacheInvalidationPending = true;
+
+    auto it = pendingChanges.find(entry);
+    if (it == pendingChanges.end()) {
+        pendingRoutes.push_back(entry);
+        pendingChanges[entry] = PENDING_DELETED;
+    }
+    else if (it->second == PENDING_CHANGED)
+        it->second = PENDING_DELETED;
+    else {
+        // A route that appeared within this batch is simply gone, nobody has heard of it yet
+        pendingChanges.erase(it);
+        entry->setRoutingTable(nullptr);
+        delete entry;
+    }
+    return true;
+}
+
+void FsrRoutingTable::routeChanged(Ipv4Route *entry, int fieldCode)
+{
+    if (batchDepth == 0) {
+        Ipv4RoutingTable::routeChanged(entry, fieldCode);
+        return;
+    }
+    // The route list is sorted by prefix and metric, which a change may break
+    if (fieldCode == Ipv4Route::F_DESTINATION || fieldCode == Ipv4Route::F_PREFIX_LENGTH || fieldCode == Ipv4Route::F_METRIC) {
+        internalRemoveRoute(entry);
+        internalAddRoute(entry);
+    }
+    cacheInvalidationPending = true;
+    if (pendingChanges.emplace(entry, PENDING_CHANGED).second)
+        pendingRoutes.push_back(entry);
+}
+
+void FsrRoutingTable::commitBatch()
+{
+    ASSERT(batchDepth > 0);
+    if (--batchDepth > 0)
+        return;
+
+    Enter_Method("commitBatch()");
+    if (cacheInvalidationPending) {
+        Ipv4RoutingTable::invalidateCache();
+        updateDisplayString();
+        cacheInvalidationPending = false;
+    }
+
+    // Routes added and deleted again within the batch were already freed and are no longer in the map
+    for (auto route : pendingRoutes) {
+        auto it = pendingChanges.find(route);
+        if (it == pendingChanges.end())
+            continue;
+        if (it->second == PENDING_ADDED)
+            emit(routeAddedSignal, route);
+        else if (it->second == PENDING_CHANGED)
+            emit(routeChangedSignal, route);
+        else {
+            emit(routeDeletedSignal, route);
+            route->setRoutingTable(nullptr);
+            delete route;
+        }
+        pendingChanges.erase(it);
+    }
+    pendingRoutes.clear();
+}
+
+} // namespace fsr
+} // namespace inet
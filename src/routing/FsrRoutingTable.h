@@ -0,0 +1,58 @@
+/*
+ * FsrRoutingTable.h
+ * IPv4 routing table with batched updates
+ */
+
+#ifndef INET_ROUTING_FSR_FSRROUTINGTABLE_H_
+#define INET_ROUTING_FSR_FSRROUTINGTABLE_H_
+
+#include "inet/networklayer/ipv4/Ipv4RoutingTable.h"
+#include <unordered_map>
+#include <vector>
+
+namespace inet {
+namespace fsr {
+
+/**
+ * Ipv4RoutingTable that can apply many route updates as one batch.
+ * Between beginBatch() and commitBatch(), route additions, deletions and
+ * changes only modify the route list. Cache invalidation, the display
+ * update and the route signals are held back. On commit the cache is
+ * invalidated once. Then one signal is emitted per route with a net
+ * change: a route added and deleted in the same batch emits nothing, and
+ * a route added and then modified emits only routeAdded.
+ *
+ * Outside a batch the table behaves exactly like Ipv4RoutingTable.
+ */
+class INET_API FsrRoutingTable : public Ipv4RoutingTable
+{
+  protected:
+    enum PendingChange : uint8_t { PENDING_ADDED, PENDING_CHANGED, PENDING_DELETED };
+
+    int batchDepth = 0;
+    bool cacheInvalidationPending = false;
+    std::vector<Ipv4Route *> pendingRoutes;                       // in order of first change
+    std::unordered_map<Ipv4Route *, PendingChange> pendingChanges; // net change of each pending route
+
+  protected:
+    virtual void invalidateCache() override;
+    virtual void routeChanged(Ipv4Route *entry, int fieldCode) override;
+
+  public:
+    virtual ~FsrRoutingTable() override;
+
+    using Ipv4RoutingTable::addRoute;
+    using Ipv4RoutingTable::deleteRoute;
+    virtual void addRoute(Ipv4Route *entry) override;
+    virtual bool deleteRoute(Ipv4Route *entry) override;
+
+    /** Batches nest, the outermost commitBatch() applies them. */
+    void beginBatch() { batchDepth++; }
+    void commitBatch();
+    bool isInBatch() const { return batchDepth > 0; }
+};
+
+} // namespace fsr
+} // namespace inet
+
+#endif /* INET_ROUTING_FSR_FSRROUTINGTABLE_H_ */
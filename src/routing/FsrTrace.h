@@ -0,0 +1,178 @@
+/*
+ * FsrTrace.h
+ * Low-overhead binary event trace for FSR
+ */
+
+#ifndef INET_ROUTING_FSR_FSRTRACE_H_
+#define INET_ROUTING_FSR_FSRTRACE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace inet {
+namespace fsr {
+
+/**
+ * Trace categories, enabled per module at run time.
+ */
+enum FsrTraceCategory : uint32_t {
+    FSR_TRACE_RX       = 1 << 0,
+    FSR_TRACE_TX       = 1 << 1,
+    FSR_TRACE_HELLO    = 1 << 2,
+    FSR_TRACE_LSP      = 1 << 3,
+    FSR_TRACE_RELAY    = 1 << 4,
+    FSR_TRACE_NEIGHBOR = 1 << 5,
+    FSR_TRACE_SPF      = 1 << 6,
+    FSR_TRACE_ROUTE    = 1 << 7,
+    FSR_TRACE_ALL      = 0xFFFFFFFF
+};
+
+/**
+ * Trace events and the meaning of their three arguments.
+ */
+enum FsrTraceEvent : uint16_t {
+    FSR_EV_PACKET_RECEIVED = 1,  // source, packet type, length (bytes)
+    FSR_EV_PACKET_SENT,          // destination, packet type, length (bytes)
+    FSR_EV_HELLO_RECEIVED,       // source, seq, neighbor count after processing
+    FSR_EV_LSP_ENTRY_ACCEPTED,   // originator, seq, neighbor count
+    FSR_EV_LSP_ENTRY_STALE,      // originator, seq, stored seq
+    FSR_EV_LSP_RELAYED,          // packet source (originator when aggregating), seq, new hop count
+    FSR_EV_NEIGHBOR_ADDED,       // neighbor, neighbor count
+    FSR_EV_NEIGHBOR_REMOVED,     // neighbor, neighbor count
+    FSR_EV_SPF_RUN,              // known node ids, nodes with link state, destinations recomputed
+    FSR_EV_ROUTES_UPDATED,       // added, changed, deleted
+    FSR_EV_SCOPE_UPDATE_SENT,    // scope, entries
+    FSR_EV_MALFORMED_PACKET,     // source, length (bytes)
+    FSR_EV_LSP_DELTA_GAP,        // originator, seq, base seq the delta needs
+    FSR_EV_LSP_ENTRY_EXPIRED,    // originator, seq
+};
+
+/**
+ * Fixed-size trace record, stored and dumped in host byte order.
+ */
+struct FsrTraceRecord {
+    double time;
+    uint16_t event;
+    uint16_t reserved;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+static_assert(sizeof(FsrTraceRecord) == 24, "FsrTraceRecord must stay 24 bytes");
+
+/**
+ * Header of a dumped trace file, followed by numRecords records
+ * in chronological order.
+ */
+struct FsrTraceFileHeader {
+    char magic[4];               // "FSRT"
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t nodeAddress;
+    uint32_t numRecords;
+    uint64_t totalRecorded;      // records written, including those overwritten in the ring
+    char nodeName[32];
+};
+static_assert(sizeof(FsrTraceFileHeader) == 56, "FsrTraceFileHeader must stay 56 bytes");
+
+/**
+ * Per-module ring buffer of trace records. Recording is a mask test and
+ * a 24-byte store; older records are overwritten once the ring is full.
+ */
+class FsrTraceBuffer
+{
+  protected:
+    std::vector<FsrTraceRecord> records;
+    uint32_t enabledMask = 0;
+    uint64_t total = 0;
+
+  public:
+    void configure(uint32_t mask, size_t capacity) {
+        enabledMask = capacity > 0 ? mask : 0;
+        records.assign(capacity, FsrTraceRecord());
+        total = 0;
+    }
+    bool isEnabled(uint32_t category) const { return (enabledMask & category) != 0; }
+    uint64_t getTotalRecorded() const { return total; }
+
+    void record(double time, uint16_t event, uint32_t a, uint32_t b, uint32_t c) {
+        FsrTraceRecord& r = records[total % records.size()];
+        r.time = time;
+        r.event = event;
+        r.reserved = 0;
+        r.a = a;
+        r.b = b;
+        r.c = c;
+        total++;
+    }
+
+    /** Writes the buffered records to a file, returns false on I/O error. */
+    bool dump(const char *fileName, uint32_t nodeAddress, const char *nodeName) const {
+        FILE *f = fopen(fileName, "wb");
+        if (!f)
+            return false;
+        size_t capacity = records.size();
+        size_t count = total < capacity ? (size_t)total : capacity;
+        FsrTraceFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "FSRT", 4);
+        header.version = 1;
+        header.recordSize = sizeof(FsrTraceRecord);
+        header.nodeAddress = nodeAddress;
+        header.numRecords = (uint32_t)count;
+        header.totalRecorded = total;
+        strncpy(header.nodeName, nodeName, sizeof(header.nodeName) - 1);
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        // Oldest record first
+        size_t start = total < capacity ? 0 : (size_t)(total % capacity);
+        for (size_t i = 0; ok && i < count; i++)
+            ok = fwrite(&records[(start + i) % capacity], sizeof(FsrTraceRecord), 1, f) == 1;
+        return fclose(f) == 0 && ok;
+    }
+
+    /** Parses a space-separated category list ("rx tx lsp", "all"); returns false on unknown names. */
+    static bool parseCategories(const char *spec, uint32_t& mask, std::string& unknown) {
+        static const struct { const char *name; uint32_t bit; } names[] = {
+            {"rx", FSR_TRACE_RX}, {"tx", FSR_TRACE_TX}, {"hello", FSR_TRACE_HELLO}, {"lsp", FSR_TRACE_LSP},
+            {"relay", FSR_TRACE_RELAY}, {"neighbor", FSR_TRACE_NEIGHBOR}, {"spf", FSR_TRACE_SPF},
+            {"route", FSR_TRACE_ROUTE}, {"all", FSR_TRACE_ALL},
+        };
+        mask = 0;
+        std::istringstream tokens(spec);
+        std::string token;
+        while (tokens >> token) {
+            bool found = false;
+            for (const auto& entry : names) {
+                if (token == entry.name) {
+                    mask |= entry.bit;
+                    found = true;
+                }
+            }
+            if (!found) {
+                unknown = token;
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace fsr
+} // namespace inet
+
+/**
+ * Records a trace event if its category is enabled. Defining FSR_NO_TRACE
+ * removes every trace point at compile time.
+ */
+#ifndef FSR_NO_TRACE
+#define FSR_TRACE(buffer, time, category, event, a, b, c) \
+    do { if ((buffer).isEnabled(category)) (buffer).record((time), (event), (uint32_t)(a), (uint32_t)(b), (uint32_t)(c)); } while (0)
+#else
+#define FSR_TRACE(buffer, time, category, event, a, b, c) do {} while (0)
+#endif
+
+#endif /* INET_ROUTING_FSR_FSRTRACE_H_ */
@@ -0,0 +1,63 @@
+/*
+ * FsrLinkState.cc
+ * Link-state database and route computation of FSR
+ */
+
+#include "inet/routing/fsr/core/FsrLinkState.h"
+
+namespace inet {
+namespace fsr {
+
+void FsrLinkState::setEntry(uint32_t id, uint32_t seq, std::vector<uint32_t> &neighborIds, double now, std::vector<FsrTopologyTable::LinkCost> *costs)
+{
+    if (costs && table.isWeighted()) {
+        // Sort by id, then position, so that a later duplicate overrides the cost
+        scratchLinks.clear();
+        for (size_t i = 0; i < neighborIds.size(); i++)
+            scratchLinks.push_back(std::make_pair(neighborIds[i], (uint32_t)i));
+        std::sort(scratchLinks.begin(), scratchLinks.end());
+        unsortedCosts.assign(costs->begin(), costs->end());
+        neighborIds.clear();
+        costs->clear();
+        for (const auto &link : scratchLinks) {
+            if (!neighborIds.empty() && neighborIds.back() == link.first) {
+                costs->back() = unsortedCosts[link.second];
+                continue;
+            }
+            neighborIds.push_back(link.first);
+            costs->push_back(unsortedCosts[link.second]);
+        }
+        spf.noteEntryChange(table, id, neighborIds, costs->data());
+        table.setEntry(id, seq, neighborIds, now, costs->data());
+        return;
+    }
+    std::sort(neighborIds.begin(), neighborIds.end());
+    neighborIds.erase(std::unique(neighborIds.begin(), neighborIds.end()), neighborIds.end());
+    spf.noteEntryChange(table, id, neighborIds);
+    table.setEntry(id, seq, neighborIds, now);
+}
+
+void FsrLinkState::removeEntry(uint32_t id)
+{
+    scratch.clear();
+    spf.noteEntryChange(table, id, scratch);
+    table.removeEntry(id);
+}
+
+void FsrLinkState::clear()
+{
+    table.clear();
+    spf.clear();
+}
+
+bool FsrLinkState::computeShortestPaths(uint32_t sourceId, std::vector<uint32_t> &changedIds)
+{
+    // The incremental engine replays the link changes since the last run on the previous tree
+    if (spf.getSource() == sourceId && spf.update(table, changedIds))
+        return true;
+    spf.compute(table, sourceId);
+    return false;
+}
+
+} // namespace fsr
+} // namespace inet
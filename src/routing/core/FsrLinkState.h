@@ -0,0 +1,136 @@
+/*
+ * FsrLinkState.h
+ * Link-state database and route computation of FSR
+ */
+
+#ifndef INET_ROUTING_FSR_CORE_FSRLINKSTATE_H_
+#define INET_ROUTING_FSR_CORE_FSRLINKSTATE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "inet/routing/fsr/core/FsrSpf.h"
+#include "inet/routing/fsr/core/FsrTopologyTable.h"
+
+namespace inet {
+namespace fsr {
+
+/**
+ * Protocol state that does not depend on the simulator: the topology
+ * table, the rules for accepting received LSP entries and the shortest
+ * path computation over the result. Times are plain seconds supplied by
+ * the caller, so the class runs unchanged inside the Fsr module and in
+ * standalone benchmarks.
+ */
+class FsrLinkState
+{
+  public:
+    enum ApplyResult {
+        APPLY_ACCEPTED,  // entry stored
+        APPLY_STALE,     // not newer than the stored version
+        APPLY_GAP,       // delta against a version we do not have
+    };
+
+  protected:
+    FsrTopologyTable table;
+    FsrSpf spf;
+    std::vector<uint32_t> scratch;   // reused neighbor id buffer
+    std::vector<FsrTopologyTable::LinkCost> scratchCosts;
+    std::vector<std::pair<uint32_t, uint32_t>> scratchLinks;   // (neighbor id, position)
+    std::vector<FsrTopologyTable::LinkCost> unsortedCosts;
+
+  public:
+    const FsrTopologyTable &getTable() const { return table; }
+    const FsrSpf &getSpf() const { return spf; }
+    uint32_t intern(uint32_t address) { return table.intern(address); }
+
+    /** Enables incremental SPF, see FsrSpf::update(). */
+    void setTrackChanges(bool track) { spf.setTrackChanges(track); }
+
+    /** Uses advertised link costs instead of hop count; only while the table is empty. */
+    void setWeighted(bool weighted) { table.setWeighted(weighted); }
+
+    /** Charges transit through loaded nodes, see FsrSpf::setLoadPenalty(). */
+    void setLoadPenalty(uint32_t penalty) { spf.setLoadPenalty(penalty); }
+
+    /**
+     * Stores an entry built locally; the list is sorted and deduplicated in
+     * place. In a weighted table costs, if given, holds one cost per
+     * neighbor and is reordered alongside; of duplicates the last one wins.
+     */
+    void setEntry(uint32_t id, uint32_t seq, std::vector<uint32_t> &neighborIds, double now, std::vector<FsrTopologyTable::LinkCost> *costs = nullptr);
+    /** Sets the load of a node that has an entry. */
+    void setLoad(uint32_t id, uint8_t load) { spf.noteLoadChange(table, id, load); table.setLoad(id, load); }
+    void removeEntry(uint32_t id);
+    void clear();
+
+    /**
+     * Applies a received entry of the node with the given id. Entry is
+     * LspEntry or any type with the same read accessors (FsrWireEntry).
+     */
+    template<typename Entry>
+    ApplyResult applyEntry(uint32_t id, const Entry &entry, double now);
+
+    /**
+     * Brings the shortest paths from sourceId up to date. Returns true if
+     * the previous result could be updated incrementally, in which case
+     * changedIds lists the nodes whose route may differ; otherwise all
+     * nodes were recomputed.
+     */
+    bool computeShortestPaths(uint32_t sourceId, std::vector<uint32_t> &changedIds);
+
+    /** Equal-cost first hops towards id after the last computation, see FsrSpf::getEqualCostNextHops(). */
+    void getEqualCostNextHops(uint32_t id, size_t maxCount, std::vector<uint32_t> &nextHops) { spf.getEqualCostNextHops(table, id, maxCount, nextHops); }
+};
+
+template<typename Entry>
+FsrLinkState::ApplyResult FsrLinkState::applyEntry(uint32_t id, const Entry &entry, double now)
+{
+    uint32_t seq = entry.getSequenceNumber();
+    if (table.hasEntry(id) && seq <= table.getSeq(id))
+        return APPLY_STALE;
+    // Versions between the stored one and seq were missed, the stable seq cannot span them
+    // unless the entry is an empty delta, which vouches for them itself
+    bool missedVersions = table.hasEntry(id) && seq > table.getSeq(id) + 1;
+
+    // Costs are only kept by a weighted table; entries without them count UNIT_COST per link
+    bool weighted = table.isWeighted();
+    bool hasCosts = entry.getLinkCostsArraySize() == entry.getNeighborsArraySize();
+    scratch.clear();
+    scratchCosts.clear();
+    if (entry.getDelta()) {
+        // A delta applies on top of any stored version not older than its base
+        if (!table.hasEntry(id) || table.getSeq(id) < entry.getBaseSequenceNumber())
+            return APPLY_GAP;
+        FsrTopologyTable::NeighborRange stored = table.getNeighbors(id);
+        scratch.assign(stored.begin(), stored.end());
+        if (weighted)
+            scratchCosts.assign(table.getCosts(id), table.getCosts(id) + stored.size());
+        for (size_t j = 0; j < entry.getRemovedNeighborsArraySize(); j++) {
+            auto it = std::find(scratch.begin(), scratch.end(), table.findId(entry.getRemovedNeighbors(j)));
+            if (it != scratch.end()) {
+                if (weighted)
+                    scratchCosts.erase(scratchCosts.begin() + (it - scratch.begin()));
+                scratch.erase(it);
+            }
+        }
+    }
+    for (size_t j = 0; j < entry.getNeighborsArraySize(); j++) {
+        scratch.push_back(table.intern(entry.getNeighbors(j)));
+        if (weighted)
+            scratchCosts.push_back(hasCosts ? std::max<FsrTopologyTable::LinkCost>(1, entry.getLinkCosts(j)) : FsrTopologyTable::UNIT_COST);
+    }
+    setEntry(id, seq, scratch, now, weighted ? &scratchCosts : nullptr);
+    // The load is carried in full by every entry, deltas included
+    setLoad(id, entry.getLoad());
+    if (missedVersions && !(entry.getDelta() && entry.getNeighborsArraySize() == 0 && entry.getRemovedNeighborsArraySize() == 0))
+        table.resetStableSeq(id);
+    return APPLY_ACCEPTED;
+}
+
+} // namespace fsr
+} // namespace inet
+
+#endif /* INET_ROUTING_FSR_CORE_FSRLINKSTATE_H_ */
@@ -0,0 +1,358 @@
+/*
+ * FsrSpf.cc
+ * Indexed shortest-path engine for FSR
+ */
+
+#include "inet/routing/fsr/core/FsrSpf.h"
+
+#include <algorithm>
+
+namespace inet {
+namespace fsr {
+
+void FsrSpf::clear()
+{
+    distance.clear();
+    hops.clear();
+    nextHop.clear();
+    parent.clear();
+    queue.clear();
+    source = NO_NODE;
+    invalidate();
+}
+
+void FsrSpf::invalidate()
+{
+    valid = false;
+    preds.clear();
+    removedLinks.clear();
+    addedLinks.clear();
+}
+
+void FsrSpf::resize(uint32_t n)
+{
+    if (distance.size() >= n)
+        return;
+    distance.resize(n, INFINITE_DISTANCE);
+    hops.resize(n, INFINITE_DISTANCE);
+    nextHop.resize(n, NO_NODE);
+    parent.resize(n, NO_NODE);
+    preds.resize(n);
+    affected.resize(n, 0);
+    touched.resize(n, 0);
+}
+
+void FsrSpf::touch(uint32_t id)
+{
+    if (!touched[id]) {
+        touched[id] = 1;
+        touchedList.push_back(id);
+    }
+}
+
+uint32_t FsrSpf::distanceVia(const FsrTopologyTable &table, uint32_t from, uint32_t to) const
+{
+    if (distance[from] == INFINITE_DISTANCE)
+        return INFINITE_DISTANCE;
+    uint32_t cost = table.getLinkCost(from, to);
+    return cost == FsrTopologyTable::NO_LINK ? INFINITE_DISTANCE : distance[from] + getTransitCost(table, from) + cost;
+}
+
+uint32_t FsrSpf::getTransitCost(const FsrTopologyTable &table, uint32_t id) const
+{
+    // The source's own load would shift every path alike, it is left out
+    if (loadPenalty == 0 || id == source || !table.isWeighted())
+        return 0;
+    return loadPenalty * table.getLoad(id) / 255;
+}
+
+void FsrSpf::compute(const FsrTopologyTable &table, uint32_t sourceId)
+{
+    uint32_t n = table.getNumIds();
+    distance.assign(n, INFINITE_DISTANCE);
+    hops.assign(n, INFINITE_DISTANCE);
+    nextHop.assign(n, NO_NODE);
+    parent.assign(n, NO_NODE);
+    source = sourceId;
+    invalidate();
+    if (sourceId >= n)
+        return;
+
+    distance[sourceId] = 0;
+    hops[sourceId] = 0;
+    if (table.isWeighted()) {
+        minQueue.push(QueueItem(0, sourceId));
+        while (!minQueue.empty()) {
+            QueueItem item = minQueue.top();
+            minQueue.pop();
+            uint32_t u = item.second;
+            if (item.first != distance[u] || !table.hasEntry(u))
+                continue;
+            FsrTopologyTable::NeighborRange range = table.getNeighbors(u);
+            const FsrTopologyTable::LinkCost *costs = table.getCosts(u);
+            uint32_t du = distance[u] + getTransitCost(table, u);
+            for (size_t i = 0; i < range.size(); i++) {
+                uint32_t v = range.begin()[i];
+                uint32_t dv = du + costs[i];
+                if (dv >= distance[v])
+                    continue;
+                distance[v] = dv;
+                hops[v] = hops[u] + 1;
+                nextHop[v] = (u == sourceId) ? v : nextHop[u];
+                parent[v] = u;
+                minQueue.push(QueueItem(dv, v));
+            }
+        }
+    }
+    else {
+        queue.resize(n);
+        uint32_t head = 0, tail = 0;
+        queue[tail++] = sourceId;
+        while (head < tail) {
+            uint32_t u = queue[head++];
+            if (!table.hasEntry(u))
+                continue;
+            uint32_t du = distance[u] + 1;
+            for (uint32_t v : table.getNeighbors(u)) {
+                if (distance[v] != INFINITE_DISTANCE)
+                    continue;
+                distance[v] = du;
+                hops[v] = du;
+                nextHop[v] = (u == sourceId) ? v : nextHop[u];
+                parent[v] = u;
+                queue[tail++] = v;
+            }
+        }
+    }
+
+    if (trackChanges) {
+        preds.assign(n, std::vector<uint32_t>());
+        affected.assign(n, 0);
+        touched.assign(n, 0);
+        for (uint32_t u = 0; u < n; u++) {
+            if (table.hasEntry(u)) {
+                for (uint32_t v : table.getNeighbors(u))
+                    preds[v].push_back(u);
+            }
+        }
+        valid = true;
+    }
+}
+
+void FsrSpf::noteEntryChange(const FsrTopologyTable &table, uint32_t id, const std::vector<uint32_t> &newNeighborIds, const FsrTopologyTable::LinkCost *newCosts)
+{
+    if (!valid)
+        return;
+    resize(table.getNumIds());
+
+    // Both lists are sorted, walk them together
+    FsrTopologyTable::NeighborRange oldNeighborIds = table.hasEntry(id) ? table.getNeighbors(id) : FsrTopologyTable::NeighborRange{nullptr, nullptr};
+    const FsrTopologyTable::LinkCost *oldCosts = table.hasEntry(id) ? table.getCosts(id) : nullptr;
+    const uint32_t *o = oldNeighborIds.begin();
+    auto n = newNeighborIds.begin();
+    while (o != oldNeighborIds.end() || n != newNeighborIds.end()) {
+        if (n == newNeighborIds.end() || (o != oldNeighborIds.end() && *o < *n)) {
+            std::vector<uint32_t> &p = preds[*o];
+            auto it = std::find(p.begin(), p.end(), id);
+            if (it != p.end())
+                p.erase(it);
+            removedLinks.push_back(Link(id, *o++));
+        }
+        else if (o == oldNeighborIds.end() || *n < *o) {
+            preds[*n].push_back(id);
+            addedLinks.push_back(Link(id, *n++));
+        }
+        else {
+            if (oldCosts) {
+                FsrTopologyTable::LinkCost oldCost = oldCosts[o - oldNeighborIds.begin()];
+                FsrTopologyTable::LinkCost newCost = newCosts ? newCosts[n - newNeighborIds.begin()] : FsrTopologyTable::UNIT_COST;
+                if (oldCost != newCost) {
+                    removedLinks.push_back(Link(id, *o));
+                    addedLinks.push_back(Link(id, *n));
+                }
+            }
+            ++o;
+            ++n;
+        }
+    }
+
+    // Past this point a full run is cheaper than replaying the changes
+    if (removedLinks.size() + addedLinks.size() > std::max<size_t>(64, distance.size()))
+        invalidate();
+}
+
+void FsrSpf::noteLoadChange(const FsrTopologyTable &table, uint32_t id, uint8_t newLoad)
+{
+    // Only the transit cost changes, which counts as a cost change of every link of the node
+    if (!valid || loadPenalty == 0 || id == source || !table.isWeighted() || !table.hasEntry(id) || table.getLoad(id) == newLoad)
+        return;
+    resize(table.getNumIds());
+    for (uint32_t v : table.getNeighbors(id)) {
+        removedLinks.push_back(Link(id, v));
+        addedLinks.push_back(Link(id, v));
+    }
+    if (removedLinks.size() + addedLinks.size() > std::max<size_t>(64, distance.size()))
+        invalidate();
+}
+
+bool FsrSpf::update(const FsrTopologyTable &table, std::vector<uint32_t> &changedIds)
+{
+    changedIds.clear();
+    if (!valid || source == NO_NODE)
+        return false;
+    resize(table.getNumIds());
+
+    // 1. Nodes whose tree link was removed look for another parent at the same distance. Nodes
+    // are settled in distance order, so candidate parents (closer to the source) are already
+    // final. Nodes without an alternative become affected, and so do their tree children.
+    for (const Link &link : removedLinks) {
+        if (parent[link.second] == link.first)
+            minQueue.push(QueueItem(distance[link.second], link.second));
+    }
+    std::vector<uint32_t> affectedList;
+    while (!minQueue.empty()) {
+        uint32_t x = minQueue.top().second;
+        minQueue.pop();
+        if (affected[x] || (parent[x] != NO_NODE && !affected[parent[x]] && distanceVia(table, parent[x], x) == distance[x]))
+            continue;
+        uint32_t newParent = NO_NODE;
+        for (uint32_t p : preds[x]) {
+            if (!affected[p] && distanceVia(table, p, x) == distance[x]) {
+                newParent = p;
+                break;
+            }
+        }
+        touch(x);
+        if (newParent != NO_NODE) {
+            parent[x] = newParent;
+            continue;
+        }
+        affected[x] = 1;
+        affectedList.push_back(x);
+        if (table.hasEntry(x)) {
+            for (uint32_t y : table.getNeighbors(x)) {
+                if (parent[y] == x)
+                    minQueue.push(QueueItem(distance[y], y));
+            }
+        }
+    }
+
+    // 2. Affected nodes get their best distance through unaffected predecessors, added links
+    // may shorten distances; both are propagated Dijkstra-style
+    for (uint32_t x : affectedList) {
+        distance[x] = INFINITE_DISTANCE;
+        parent[x] = NO_NODE;
+    }
+    for (uint32_t x : affectedList) {
+        affected[x] = 0;
+        for (uint32_t p : preds[x]) {
+            uint32_t dx = distanceVia(table, p, x);
+            if (dx < distance[x]) {
+                distance[x] = dx;
+                parent[x] = p;
+            }
+        }
+        if (distance[x] != INFINITE_DISTANCE)
+            minQueue.push(QueueItem(distance[x], x));
+    }
+    for (const Link &link : addedLinks) {
+        uint32_t u = link.first, v = link.second;
+        uint32_t dv = distanceVia(table, u, v);
+        if (dv < distance[v]) {
+            distance[v] = dv;
+            parent[v] = u;
+            touch(v);
+            minQueue.push(QueueItem(distance[v], v));
+        }
+    }
+    while (!minQueue.empty()) {
+        QueueItem item = minQueue.top();
+        minQueue.pop();
+        uint32_t x = item.second;
+        if (item.first != distance[x] || !table.hasEntry(x))
+            continue;
+        FsrTopologyTable::NeighborRange range = table.getNeighbors(x);
+        const FsrTopologyTable::LinkCost *costs = table.getCosts(x);
+        uint32_t dx = distance[x] + getTransitCost(table, x);
+        for (size_t i = 0; i < range.size(); i++) {
+            uint32_t y = range.begin()[i];
+            uint32_t dy = dx + (costs ? costs[i] : 1);
+            if (dy < distance[y]) {
+                distance[y] = dy;
+                parent[y] = x;
+                touch(y);
+                minQueue.push(QueueItem(distance[y], y));
+            }
+        }
+    }
+
+    // 3. First hops and hop counts follow the (possibly new) parents, top-down; a change is
+    // inherited by the whole subtree
+    for (uint32_t x : touchedList)
+        minQueue.push(QueueItem(distance[x], x));
+    while (!minQueue.empty()) {
+        uint32_t x = minQueue.top().second;
+        minQueue.pop();
+        uint32_t hop = parent[x] == NO_NODE ? NO_NODE : parent[x] == source ? x : nextHop[parent[x]];
+        uint32_t hopCount = parent[x] == NO_NODE ? INFINITE_DISTANCE : hops[parent[x]] + 1;
+        if (hop == nextHop[x] && hopCount == hops[x])
+            continue;
+        nextHop[x] = hop;
+        hops[x] = hopCount;
+        touch(x);
+        if (table.hasEntry(x)) {
+            for (uint32_t y : table.getNeighbors(x)) {
+                if (parent[y] == x)
+                    minQueue.push(QueueItem(distance[y], y));
+            }
+        }
+    }
+
+    for (uint32_t x : touchedList)
+        touched[x] = 0;
+    changedIds.swap(touchedList);
+    touchedList.clear();
+    removedLinks.clear();
+    addedLinks.clear();
+    return true;
+}
+
+void FsrSpf::getEqualCostNextHops(const FsrTopologyTable &table, uint32_t id, size_t maxCount, std::vector<uint32_t> &nextHops)
+{
+    nextHops.clear();
+    if (id == source || !isReachable(id) || maxCount == 0)
+        return;
+    nextHops.push_back(nextHop[id]);
+
+    // touched is clean outside update(), it marks the DAG nodes already expanded here
+    if (touched.size() < distance.size())
+        touched.resize(distance.size(), 0);
+    queue.clear();
+    queue.push_back(id);
+    touch(id);
+    while (!queue.empty() && nextHops.size() < maxCount) {
+        uint32_t x = queue.back();
+        queue.pop_back();
+        if (!table.hasEntry(x))
+            continue;
+        for (uint32_t p : table.getNeighbors(x)) {
+            if (p >= distance.size() || distanceVia(table, p, x) != distance[x])
+                continue;
+            if (p == source) {
+                if (std::find(nextHops.begin(), nextHops.end(), x) == nextHops.end() && nextHops.size() < maxCount)
+                    nextHops.push_back(x);
+            }
+            else if (!touched[p]) {
+                touch(p);
+                queue.push_back(p);
+            }
+        }
+    }
+
+    for (uint32_t x : touchedList)
+        touched[x] = 0;
+    touchedList.clear();
+}
+
+} // namespace fsr
+} // namespace inet
@@ -0,0 +1,125 @@
+/*
+ * FsrSpf.h
+ * Indexed shortest-path engine for FSR
+ */
+
+#ifndef INET_ROUTING_FSR_CORE_FSRSPF_H_
+#define INET_ROUTING_FSR_CORE_FSRSPF_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "inet/routing/fsr/core/FsrTopologyTable.h"
+
+namespace inet {
+namespace fsr {
+
+/**
+ * Shortest-path engine over the dense-id adjacency of an FsrTopologyTable.
+ * Unweighted tables are searched with a plain BFS, weighted ones with
+ * Dijkstra over the stored link costs; result and scratch buffers are kept
+ * between runs to avoid reallocation. Besides the distance (path cost) the
+ * hop count along the chosen path is kept.
+ *
+ * With change tracking enabled, link changes reported through
+ * noteEntryChange() are applied by update() to the existing shortest-path
+ * tree in the spirit of Ramalingam-Reps: only nodes that lost their tree
+ * parent are re-examined, and only the part of the tree whose distance
+ * or first hop actually changes is recomputed. A changed link cost counts
+ * as the removal of the old link plus the addition of the new one.
+ *
+ * With a load penalty set, leaving a node other than the source over any
+ * of its links costs extra in proportion to the node's advertised load,
+ * so that paths avoid relaying through congested nodes. The penalty only
+ * applies to weighted tables.
+ */
+class FsrSpf
+{
+  public:
+    static constexpr uint32_t INFINITE_DISTANCE = UINT32_MAX;
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+  protected:
+    typedef std::pair<uint32_t, uint32_t> Link;                 // (from, to)
+    typedef std::pair<uint32_t, uint32_t> QueueItem;            // (distance, id)
+    typedef std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> MinQueue;
+
+    // Per-node results, indexed by topology id
+    std::vector<uint32_t> distance;
+    std::vector<uint32_t> hops;      // hop count of the chosen path
+    std::vector<uint32_t> nextHop;   // id of the first hop
+    std::vector<uint32_t> parent;    // predecessor in the shortest-path tree
+    std::vector<uint32_t> queue;
+    uint32_t source = NO_NODE;
+    uint32_t loadPenalty = 0;        // transit cost of a node with load 255
+
+    // Change tracking for update()
+    bool trackChanges = false;
+    bool valid = false;              // tree matches the table apart from the pending links
+    std::vector<std::vector<uint32_t>> preds; // reverse adjacency
+    std::vector<Link> removedLinks;
+    std::vector<Link> addedLinks;
+    std::vector<uint8_t> affected;
+    std::vector<uint8_t> touched;
+    std::vector<uint32_t> touchedList;
+    MinQueue minQueue;
+
+  protected:
+    void resize(uint32_t n);
+    void touch(uint32_t id);
+    void invalidate();
+    uint32_t distanceVia(const FsrTopologyTable &table, uint32_t from, uint32_t to) const;
+    uint32_t getTransitCost(const FsrTopologyTable &table, uint32_t id) const;
+
+  public:
+    void clear();
+    void setTrackChanges(bool track) { trackChanges = track; if (!track) invalidate(); }
+    /** Sets the extra cost of relaying through a fully loaded node, 0 to ignore loads. */
+    void setLoadPenalty(uint32_t penalty) { loadPenalty = penalty; invalidate(); }
+
+    /** Runs BFS or Dijkstra from the given node over all entries of the table. */
+    void compute(const FsrTopologyTable &table, uint32_t sourceId);
+
+    /**
+     * Records the link changes of an entry before the table is updated.
+     * The new neighbor list must be sorted and free of duplicates, an
+     * empty list stands for a removed entry. newCosts are the costs the
+     * table will store (nullptr: UNIT_COST each), ignored if unweighted.
+     */
+    void noteEntryChange(const FsrTopologyTable &table, uint32_t id, const std::vector<uint32_t> &newNeighborIds, const FsrTopologyTable::LinkCost *newCosts = nullptr);
+
+    /** Records a load change of a node before the table is updated. */
+    void noteLoadChange(const FsrTopologyTable &table, uint32_t id, uint8_t newLoad);
+
+    /**
+     * Applies the recorded changes to the previous result. Returns false
+     * if that is not possible (no previous result, too many changes), in
+     * which case compute() is needed. Otherwise changedIds receives every
+     * node whose distance or first hop may have changed.
+     */
+    bool update(const FsrTopologyTable &table, std::vector<uint32_t> &changedIds);
+
+    /**
+     * Collects the first hops of all shortest paths to the given node,
+     * the tree's own first hop first, at most maxCount of them. Works
+     * backwards over the shortest-path DAG; the predecessors of a node are
+     * sought among its own advertised neighbors.
+     */
+    void getEqualCostNextHops(const FsrTopologyTable &table, uint32_t id, size_t maxCount, std::vector<uint32_t> &nextHops);
+
+    uint32_t getNumNodes() const { return (uint32_t)distance.size(); }
+    uint32_t getSource() const { return source; }
+    uint32_t getDistance(uint32_t id) const { return id < distance.size() ? distance[id] : INFINITE_DISTANCE; }
+    uint32_t getHopCount(uint32_t id) const { return id < hops.size() ? hops[id] : INFINITE_DISTANCE; }
+    uint32_t getNextHop(uint32_t id) const { return nextHop[id]; }
+    bool isReachable(uint32_t id) const { return getDistance(id) != INFINITE_DISTANCE; }
+};
+
+} // namespace fsr
+} // namespace inet
+
+#endif /* INET_ROUTING_FSR_CORE_FSRSPF_H_ */
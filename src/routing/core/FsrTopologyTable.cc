@@ -0,0 +1,197 @@
+/*
+ * FsrTopologyTable.cc
+ * Compact topology table for FSR
+ */
+
+#include "inet/routing/fsr/core/FsrTopologyTable.h"
+
+#include <algorithm>
+
+namespace inet {
+namespace fsr {
+
+uint32_t FsrTopologyTable::intern(uint32_t address)
+{
+    // Look up first, emplace() would allocate a node even for known addresses
+    auto it = idOf.find(address);
+    if (it != idOf.end())
+        return it->second;
+    auto result = idOf.emplace(address, (uint32_t)addressOf.size());
+    if (result.second) {
+        addressOf.push_back(address);
+        seqs.push_back(0);
+        stableSeqs.push_back(0);
+        updateTimes.push_back(0);
+        loads.push_back(0);
+        present.push_back(0);
+        slotOffset.push_back(0);
+        slotLength.push_back(0);
+        slotCapacity.push_back(0);
+    }
+    return result.first->second;
+}
+
+uint32_t FsrTopologyTable::findId(uint32_t address) const
+{
+    auto it = idOf.find(address);
+    return it != idOf.end() ? it->second : NO_ID;
+}
+
+FsrTopologyTable::NeighborRange FsrTopologyTable::getNeighbors(uint32_t id) const
+{
+    const uint32_t *first = pool.data() + slotOffset[id];
+    return NeighborRange{first, first + slotLength[id]};
+}
+
+bool FsrTopologyTable::hasLink(uint32_t from, uint32_t to) const
+{
+    if (!hasEntry(from))
+        return false;
+    NeighborRange range = getNeighbors(from);
+    return std::binary_search(range.begin(), range.end(), to);
+}
+
+uint32_t FsrTopologyTable::getLinkCost(uint32_t from, uint32_t to) const
+{
+    if (!hasEntry(from))
+        return NO_LINK;
+    NeighborRange range = getNeighbors(from);
+    const uint32_t *it = std::lower_bound(range.begin(), range.end(), to);
+    if (it == range.end() || *it != to)
+        return NO_LINK;
+    return weighted ? costPool[it - pool.data()] : 1;
+}
+
+bool FsrTopologyTable::hasNeighbors(uint32_t id, const std::vector<uint32_t> &sortedNeighborIds, const LinkCost *costs) const
+{
+    if (!hasEntry(id))
+        return false;
+    NeighborRange range = getNeighbors(id);
+    if (range.size() != sortedNeighborIds.size() || !std::equal(range.begin(), range.end(), sortedNeighborIds.begin()))
+        return false;
+    if (!weighted)
+        return true;
+    const LinkCost *stored = getCosts(id);
+    for (size_t i = 0; i < range.size(); i++) {
+        if (stored[i] != (costs ? costs[i] : UNIT_COST))
+            return false;
+    }
+    return true;
+}
+
+void FsrTopologyTable::setEntry(uint32_t id, uint32_t seq, std::vector<uint32_t> &neighborIds, double updateTime, const LinkCost *costs)
+{
+    if (!costs) {
+        std::sort(neighborIds.begin(), neighborIds.end());
+        neighborIds.erase(std::unique(neighborIds.begin(), neighborIds.end()), neighborIds.end());
+    }
+    uint32_t n = (uint32_t)neighborIds.size();
+
+    if (!hasNeighbors(id, neighborIds, costs))
+        stableSeqs[id] = seq;
+    if (!present[id]) {
+        present[id] = 1;
+        numEntries++;
+    }
+    seqs[id] = seq;
+    updateTimes[id] = updateTime;
+
+    // Reuse the slot in place when the new list fits, otherwise move it to the end of the pool
+    if (n > slotCapacity[id]) {
+        releaseSlot(id);
+        if (garbage > 1024 && garbage > pool.size() / 2)
+            compact();
+        slotOffset[id] = (uint32_t)pool.size();
+        slotCapacity[id] = n + n / 4;
+        pool.resize(pool.size() + slotCapacity[id]);
+        if (weighted)
+            costPool.resize(pool.size());
+    }
+    std::copy(neighborIds.begin(), neighborIds.end(), pool.begin() + slotOffset[id]);
+    if (weighted) {
+        if (costs)
+            std::copy(costs, costs + n, costPool.begin() + slotOffset[id]);
+        else
+            std::fill(costPool.begin() + slotOffset[id], costPool.begin() + slotOffset[id] + n, UNIT_COST);
+    }
+    slotLength[id] = n;
+}
+
+void FsrTopologyTable::setLoad(uint32_t id, uint8_t load)
+{
+    if (!hasEntry(id) || loads[id] == load)
+        return;
+    loads[id] = load;
+    stableSeqs[id] = seqs[id];
+}
+
+void FsrTopologyTable::removeEntry(uint32_t id)
+{
+    if (!hasEntry(id))
+        return;
+    present[id] = 0;
+    numEntries--;
+    seqs[id] = 0;
+    stableSeqs[id] = 0;
+    updateTimes[id] = 0;
+    loads[id] = 0;
+    releaseSlot(id);
+}
+
+void FsrTopologyTable::releaseSlot(uint32_t id)
+{
+    garbage += slotCapacity[id];
+    slotOffset[id] = 0;
+    slotLength[id] = 0;
+    slotCapacity[id] = 0;
+}
+
+void FsrTopologyTable::compact()
+{
+    // Rewrite all live slots contiguously in id order
+    std::vector<uint32_t> packed;
+    std::vector<LinkCost> packedCosts;
+    packed.reserve(pool.size() - garbage);
+    if (weighted)
+        packedCosts.reserve(pool.size() - garbage);
+    for (uint32_t id = 0; id < getNumIds(); id++) {
+        uint32_t offset = (uint32_t)packed.size();
+        packed.insert(packed.end(), pool.begin() + slotOffset[id], pool.begin() + slotOffset[id] + slotCapacity[id]);
+        if (weighted)
+            packedCosts.insert(packedCosts.end(), costPool.begin() + slotOffset[id], costPool.begin() + slotOffset[id] + slotCapacity[id]);
+        slotOffset[id] = offset;
+    }
+    pool.swap(packed);
+    costPool.swap(packedCosts);
+    garbage = 0;
+}
+
+void FsrTopologyTable::clear()
+{
+    idOf.clear();
+    addressOf.clear();
+    seqs.clear();
+    stableSeqs.clear();
+    updateTimes.clear();
+    loads.clear();
+    present.clear();
+    slotOffset.clear();
+    slotLength.clear();
+    slotCapacity.clear();
+    pool.clear();
+    costPool.clear();
+    garbage = 0;
+    numEntries = 0;
+}
+
+size_t FsrTopologyTable::getMemoryUsage() const
+{
+    size_t perId = sizeof(uint32_t) * 6 + sizeof(double) + sizeof(uint8_t) * 2;
+    return addressOf.capacity() * perId
+            + idOf.size() * (sizeof(uint32_t) * 2 + sizeof(void *) * 2)
+            + pool.capacity() * sizeof(uint32_t)
+            + costPool.capacity() * sizeof(LinkCost);
+}
+
+} // namespace fsr
+} // namespace inet
@@ -0,0 +1,121 @@
+/*
+ * FsrTopologyTable.h
+ * Compact topology table for FSR
+ */
+
+#ifndef INET_ROUTING_FSR_CORE_FSRTOPOLOGYTABLE_H_
+#define INET_ROUTING_FSR_CORE_FSRTOPOLOGYTABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace inet {
+namespace fsr {
+
+/**
+ * Link-state database keyed by dense node ids. Addresses are interned
+ * once, per-node metadata is kept in struct-of-arrays form and neighbor
+ * lists are sorted id arrays stored in slots of a single shared pool.
+ *
+ * A weighted table also keeps a cost per link in a second pool laid out
+ * like the first; in an unweighted one every link costs 1.
+ *
+ * Each node also has a load indicator (0 idle, 255 saturated) as last
+ * advertised by it, which the shortest-path engine may charge for transit.
+ */
+class FsrTopologyTable
+{
+  public:
+    typedef uint16_t LinkCost;
+    static constexpr uint32_t NO_ID = UINT32_MAX;
+    static constexpr uint32_t NO_LINK = UINT32_MAX;
+    static constexpr LinkCost UNIT_COST = 100;   // weighted tables: a perfect link, and the cost of links given without one
+
+    struct NeighborRange {
+        const uint32_t *first;
+        const uint32_t *last;
+        const uint32_t *begin() const { return first; }
+        const uint32_t *end() const { return last; }
+        size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+    };
+
+  protected:
+    // Address interning
+    std::unordered_map<uint32_t, uint32_t> idOf;
+    std::vector<uint32_t> addressOf;
+
+    // Per-node metadata, indexed by id
+    std::vector<uint32_t> seqs;
+    std::vector<uint32_t> stableSeqs;   // oldest seq since which the neighbor list and load are unchanged
+    std::vector<double> updateTimes;    // when the entry was last set, for expiry
+    std::vector<uint8_t> loads;
+    std::vector<uint8_t> present;
+
+    // Neighbor list slots in the shared pool
+    std::vector<uint32_t> slotOffset;
+    std::vector<uint32_t> slotLength;
+    std::vector<uint32_t> slotCapacity;
+    std::vector<uint32_t> pool;
+    std::vector<LinkCost> costPool;     // parallel to pool, weighted tables only
+    bool weighted = false;
+    size_t garbage = 0;      // pool words no longer referenced by any slot
+    uint32_t numEntries = 0;
+
+  protected:
+    void releaseSlot(uint32_t id);
+    void compact();
+
+  public:
+    /** Chooses between cost 1 per link and stored costs, only while the table is empty. */
+    void setWeighted(bool weighted) { this->weighted = weighted; }
+    bool isWeighted() const { return weighted; }
+
+    /** Returns the dense id of the address, interning it if needed. */
+    uint32_t intern(uint32_t address);
+    uint32_t findId(uint32_t address) const;
+    uint32_t getAddress(uint32_t id) const { return addressOf[id]; }
+    uint32_t getNumIds() const { return (uint32_t)addressOf.size(); }
+
+    /** Number of nodes that currently have an entry. */
+    uint32_t size() const { return numEntries; }
+    bool hasEntry(uint32_t id) const { return id < present.size() && present[id]; }
+    uint32_t getSeq(uint32_t id) const { return seqs[id]; }
+    uint32_t getStableSeq(uint32_t id) const { return stableSeqs[id]; }
+    double getUpdateTime(uint32_t id) const { return updateTimes[id]; }
+    uint8_t getLoad(uint32_t id) const { return loads[id]; }
+
+    NeighborRange getNeighbors(uint32_t id) const;
+    /** Costs parallel to getNeighbors(id), nullptr in an unweighted table. */
+    const LinkCost *getCosts(uint32_t id) const { return weighted ? costPool.data() + slotOffset[id] : nullptr; }
+    bool hasLink(uint32_t from, uint32_t to) const;
+    /** Cost of the link, NO_LINK if there is none. */
+    uint32_t getLinkCost(uint32_t from, uint32_t to) const;
+    bool hasNeighbors(uint32_t id, const std::vector<uint32_t> &sortedNeighborIds, const LinkCost *costs = nullptr) const;
+
+    /**
+     * Creates or replaces the entry of the given node, stamped with the
+     * given update time. Without costs the neighbor id list is sorted and
+     * deduplicated in place, and in a weighted table every link gets
+     * UNIT_COST. With costs (one per neighbor) the list must already be
+     * sorted and free of duplicates. The stable seq is kept if neither the
+     * list nor its costs changed, otherwise it becomes seq.
+     */
+    void setEntry(uint32_t id, uint32_t seq, std::vector<uint32_t> &neighborIds, double updateTime, const LinkCost *costs = nullptr);
+    /** Sets the load of an existing entry; a change resets the stable seq like a new neighbor list. */
+    void setLoad(uint32_t id, uint8_t load);
+    /** Makes the stored version the stable seq, for entries whose earlier versions were not all seen. */
+    void resetStableSeq(uint32_t id) { stableSeqs[id] = seqs[id]; }
+    void removeEntry(uint32_t id);
+    void clear();
+
+    /** Bytes held by the table, for memory accounting. */
+    size_t getMemoryUsage() const;
+};
+
+} // namespace fsr
+} // namespace inet
+
+#endif /* INET_ROUTING_FSR_CORE_FSRTOPOLOGYTABLE_H_ */
@@ -0,0 +1,96 @@
+/*
+ * FsrWire.cc
+ * Simulator-independent wire codec for FSR packets
+ */
+
+#include "inet/routing/fsr/core/FsrWire.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace inet {
+namespace fsr {
+
+namespace {
+
+// Appends to a byte vector, big-endian
+struct BufferWriter
+{
+    std::vector<uint8_t> &bytes;
+
+    void writeUint8(uint8_t value) { bytes.push_back(value); }
+
+    void writeUint16Be(uint16_t value)
+    {
+        bytes.push_back(value >> 8);
+        bytes.push_back(value & 0xFF);
+    }
+
+    void writeUint32Be(uint32_t value)
+    {
+        bytes.push_back(value >> 24);
+        bytes.push_back((value >> 16) & 0xFF);
+        bytes.push_back((value >> 8) & 0xFF);
+        bytes.push_back(value & 0xFF);
+    }
+};
+
+// Bounds-checked big-endian reader, reads past the end yield zero and set overrun
+struct BufferReader
+{
+    const uint8_t *data;
+    size_t length;
+    size_t pos = 0;
+    bool overrun = false;
+
+    size_t getRemainingBytes() const { return pos < length ? length - pos : 0; }
+    bool isReadBeyondEnd() const { return overrun; }
+
+    uint32_t read(int size)
+    {
+        if (getRemainingBytes() < (size_t)size) {
+            overrun = true;
+            pos = length;
+            return 0;
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < size; i++)
+            value = (value << 8) | data[pos++];
+        return value;
+    }
+
+    uint8_t readUint8() { return read(1); }
+    uint16_t readUint16Be() { return read(2); }
+    uint32_t readUint32Be() { return read(4); }
+};
+
+} // namespace
+
+size_t FsrWireCodec::getEntryLength(size_t neighborCount, bool delta, size_t removedCount, bool costs, bool load)
+{
+    size_t length = ENTRY_HEADER_LENGTH + (load ? 1 : 0) + (costs ? 6 : 4) * neighborCount;
+    if (delta)
+        length += DELTA_HEADER_LENGTH + 4 * removedCount;
+    return length;
+}
+
+void FsrWireCodec::encode(const FsrWirePacket &packet, std::vector<uint8_t> &bytes)
+{
+    if (const char *list = findOverlongList(packet))
+        throw std::length_error(std::string("FsrWireCodec: ") + list + " list too long for its count field");
+    bytes.reserve(bytes.size() + getLength(packet));
+    BufferWriter writer{bytes};
+    write(packet, writer);
+}
+
+bool FsrWireCodec::decode(const uint8_t *data, size_t length, FsrWirePacket &packet, size_t *consumed)
+{
+    BufferReader reader{data, length};
+    bool correct = read(reader, packet);
+    if (consumed)
+        *consumed = reader.pos;
+    return correct;
+}
+
+} // namespace fsr
+} // namespace inet
@@ -0,0 +1,330 @@
+/*
+ * FsrWire.h
+ * Simulator-independent wire codec for FSR packets
+ */
+
+#ifndef INET_ROUTING_FSR_CORE_FSRWIRE_H_
+#define INET_ROUTING_FSR_CORE_FSRWIRE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace inet {
+namespace fsr {
+
+/**
+ * Plain form of an LspEntry. The accessors mirror the generated LspEntry
+ * so that code templated on the entry type accepts both.
+ */
+struct FsrWireEntry
+{
+    uint32_t nodeAddress = 0;
+    uint32_t sequenceNumber = 0;
+    std::vector<uint32_t> neighbors;
+    bool delta = false;
+    uint32_t baseSequenceNumber = 0;
+    std::vector<uint32_t> removedNeighbors;
+    std::vector<uint16_t> linkCosts;   // empty or parallel to neighbors
+    uint8_t load = 0;
+
+    uint32_t getNodeAddress() const { return nodeAddress; }
+    uint32_t getSequenceNumber() const { return sequenceNumber; }
+    size_t getNeighborsArraySize() const { return neighbors.size(); }
+    uint32_t getNeighbors(size_t i) const { return neighbors[i]; }
+    bool getDelta() const { return delta; }
+    uint32_t getBaseSequenceNumber() const { return baseSequenceNumber; }
+    size_t getRemovedNeighborsArraySize() const { return removedNeighbors.size(); }
+    uint32_t getRemovedNeighbors(size_t i) const { return removedNeighbors[i]; }
+    size_t getLinkCostsArraySize() const { return linkCosts.size(); }
+    uint16_t getLinkCosts(size_t i) const { return linkCosts[i]; }
+    uint8_t getLoad() const { return load; }
+
+    void setNodeAddress(uint32_t address) { nodeAddress = address; }
+    void setSequenceNumber(uint32_t seq) { sequenceNumber = seq; }
+    void setNeighborsArraySize(size_t size) { neighbors.resize(size); }
+    void setNeighbors(size_t i, uint32_t neighbor) { neighbors[i] = neighbor; }
+    void setDelta(bool delta) { this->delta = delta; }
+    void setBaseSequenceNumber(uint32_t seq) { baseSequenceNumber = seq; }
+    void setRemovedNeighborsArraySize(size_t size) { removedNeighbors.resize(size); }
+    void setRemovedNeighbors(size_t i, uint32_t neighbor) { removedNeighbors[i] = neighbor; }
+    void setLinkCostsArraySize(size_t size) { linkCosts.resize(size); }
+    void setLinkCosts(size_t i, uint16_t cost) { linkCosts[i] = cost; }
+    void setLoad(uint8_t load) { this->load = load; }
+};
+
+/** Plain form of an FsrPacket, with accessors mirroring the generated ones. */
+struct FsrWirePacket
+{
+    uint8_t packetType = 0;
+    uint32_t sourceAddress = 0;
+    uint32_t sequenceNumber = 0;
+    std::vector<FsrWireEntry> lspEntries;
+    uint16_t holdTime = 0;        // HELLO only, in HOLD_TIME_UNIT
+    std::vector<uint32_t> mprs;   // HELLO only
+    std::vector<uint32_t> reportedNeighbors;   // HELLO only
+    std::vector<uint8_t> deliveryRatios;       // HELLO only, parallel to reportedNeighbors
+
+    uint8_t getPacketType() const { return packetType; }
+    uint32_t getSourceAddress() const { return sourceAddress; }
+    uint32_t getSequenceNumber() const { return sequenceNumber; }
+    size_t getLspEntriesArraySize() const { return lspEntries.size(); }
+    const FsrWireEntry &getLspEntries(size_t i) const { return lspEntries[i]; }
+    uint16_t getHoldTime() const { return holdTime; }
+    size_t getMprsArraySize() const { return mprs.size(); }
+    uint32_t getMprs(size_t i) const { return mprs[i]; }
+    size_t getReportedNeighborsArraySize() const { return reportedNeighbors.size(); }
+    uint32_t getReportedNeighbors(size_t i) const { return reportedNeighbors[i]; }
+    uint8_t getDeliveryRatios(size_t i) const { return deliveryRatios[i]; }
+
+    void setPacketType(uint8_t type) { packetType = type; }
+    void setSourceAddress(uint32_t address) { sourceAddress = address; }
+    void setSequenceNumber(uint32_t seq) { sequenceNumber = seq; }
+    void setLspEntriesArraySize(size_t size) { lspEntries.resize(size); }
+    FsrWireEntry &getLspEntriesForUpdate(size_t i) { return lspEntries[i]; }
+    void setHoldTime(uint16_t holdTime) { this->holdTime = holdTime; }
+    void setMprsArraySize(size_t size) { mprs.resize(size); }
+    void setMprs(size_t i, uint32_t mpr) { mprs[i] = mpr; }
+    void setReportedNeighborsArraySize(size_t size) { reportedNeighbors.resize(size); }
+    void setReportedNeighbors(size_t i, uint32_t neighbor) { reportedNeighbors[i] = neighbor; }
+    void setDeliveryRatiosArraySize(size_t size) { deliveryRatios.resize(size); }
+    void setDeliveryRatios(size_t i, uint8_t ratio) { deliveryRatios[i] = ratio; }
+};
+
+/**
+ * Encodes and decodes the big-endian FSR wire format:
+ *
+ *   type(1) source(4) seq(4) entryCount(2)
+ *   entryCount x { node(4) seq(4) neighborCount(2) neighborCount x neighbor(4) }
+ *
+ * The top bit of neighborCount marks a delta entry, whose added neighbors
+ * are followed by base(4) removedCount(2) removedCount x neighbor(4). The
+ * next bit (COST_FLAG) means every added neighbor is followed by cost(2),
+ * and the one after it (LOAD_FLAG) that neighborCount is followed by
+ * load(1); entries without it have load 0.
+ * HELLO packets end with holdTime(2) mprCount(2) mprCount x mpr(4)
+ * reportCount(2) reportCount x { neighbor(4) ratio(1) }, the hold time
+ * counting in units of HOLD_TIME_UNIT seconds and the ratio in 1/255.
+ *
+ * The layout is defined once, by write() and read(), which are templated
+ * on the packet type (FsrPacket or FsrWirePacket) and on the stream.
+ * FsrPacketSerializer runs them on INET's memory streams; encode() and
+ * decode() run them on plain buffers for the standalone tools.
+ */
+class FsrWireCodec
+{
+  public:
+    static constexpr size_t HEADER_LENGTH = 11;
+    static constexpr size_t ENTRY_HEADER_LENGTH = 10;
+    static constexpr size_t DELTA_HEADER_LENGTH = 6;
+    static constexpr uint16_t DELTA_FLAG = 0x8000;
+    static constexpr uint16_t COST_FLAG = 0x4000;
+    static constexpr uint16_t LOAD_FLAG = 0x2000;
+    static constexpr uint16_t COUNT_MASK = 0x1FFF;
+    static constexpr uint8_t HELLO_TYPE = 1;
+    static constexpr size_t HELLO_TRAILER_LENGTH = 6;
+    static constexpr size_t DELIVERY_REPORT_LENGTH = 5;
+    static constexpr double HOLD_TIME_UNIT = 0.01;
+
+    static size_t getEntryLength(size_t neighborCount, bool delta, size_t removedCount, bool costs = false, bool load = false);
+    template<typename Entry>
+    static size_t getEntryLength(const Entry &entry);
+    template<typename Packet>
+    static size_t getLength(const Packet &packet);
+
+    /** Name of the first list of the packet that is too long for its count field, nullptr if none is. */
+    template<typename Packet>
+    static const char *findOverlongList(const Packet &packet);
+
+    /**
+     * Writes the packet to a stream with writeUint8(), writeUint16Be() and
+     * writeUint32Be(), such as MemoryOutputStream. Counts are not checked,
+     * callers reject packets for which findOverlongList() names a list.
+     */
+    template<typename Packet, typename Stream>
+    static void write(const Packet &packet, Stream &stream);
+
+    /**
+     * Reads a packet from a stream with readUint8(), readUint16Be(),
+     * readUint32Be(), isReadBeyondEnd() and getRemainingBytes(). Returns
+     * false if the data is truncated or its counts are inconsistent.
+     */
+    template<typename Packet, typename Stream>
+    static bool read(Stream &stream, Packet &packet);
+
+    /** Appends the encoded packet to bytes; throws std::length_error if a list is too long to count. */
+    static void encode(const FsrWirePacket &packet, std::vector<uint8_t> &bytes);
+
+    /**
+     * Decodes one packet from the front of the buffer. Returns false if the
+     * data is truncated or its counts are inconsistent; packet then holds
+     * what could be read. The number of bytes used is stored in consumed.
+     */
+    static bool decode(const uint8_t *data, size_t length, FsrWirePacket &packet, size_t *consumed = nullptr);
+};
+
+template<typename Entry>
+size_t FsrWireCodec::getEntryLength(const Entry &entry)
+{
+    return getEntryLength(entry.getNeighborsArraySize(), entry.getDelta(), entry.getRemovedNeighborsArraySize(), entry.getLinkCostsArraySize() > 0, entry.getLoad() != 0);
+}
+
+template<typename Packet>
+size_t FsrWireCodec::getLength(const Packet &packet)
+{
+    size_t length = HEADER_LENGTH;
+    for (size_t i = 0; i < packet.getLspEntriesArraySize(); i++)
+        length += getEntryLength(packet.getLspEntries(i));
+    if (packet.getPacketType() == HELLO_TYPE)
+        length += HELLO_TRAILER_LENGTH + 4 * packet.getMprsArraySize() + DELIVERY_REPORT_LENGTH * packet.getReportedNeighborsArraySize();
+    return length;
+}
+
+template<typename Packet>
+const char *FsrWireCodec::findOverlongList(const Packet &packet)
+{
+    if (packet.getLspEntriesArraySize() > UINT16_MAX)
+        return "lspEntries";
+    for (size_t i = 0; i < packet.getLspEntriesArraySize(); i++) {
+        const auto &entry = packet.getLspEntries(i);
+        if (entry.getNeighborsArraySize() > COUNT_MASK)
+            return "neighbors";
+        if (entry.getDelta() && entry.getRemovedNeighborsArraySize() > UINT16_MAX)
+            return "removedNeighbors";
+    }
+    if (packet.getPacketType() == HELLO_TYPE) {
+        if (packet.getMprsArraySize() > UINT16_MAX)
+            return "mprs";
+        if (packet.getReportedNeighborsArraySize() > UINT16_MAX)
+            return "reportedNeighbors";
+    }
+    return nullptr;
+}
+
+template<typename Packet, typename Stream>
+void FsrWireCodec::write(const Packet &packet, Stream &stream)
+{
+    stream.writeUint8(packet.getPacketType());
+    stream.writeUint32Be(packet.getSourceAddress());
+    stream.writeUint32Be(packet.getSequenceNumber());
+
+    size_t entryCount = packet.getLspEntriesArraySize();
+    stream.writeUint16Be(entryCount);
+    for (size_t i = 0; i < entryCount; i++) {
+        const auto &entry = packet.getLspEntries(i);
+        stream.writeUint32Be(entry.getNodeAddress());
+        stream.writeUint32Be(entry.getSequenceNumber());
+        size_t neighborCount = entry.getNeighborsArraySize();
+        bool costs = entry.getLinkCostsArraySize() > 0;
+        stream.writeUint16Be(neighborCount | (entry.getDelta() ? DELTA_FLAG : 0) | (costs ? COST_FLAG : 0) | (entry.getLoad() ? LOAD_FLAG : 0));
+        if (entry.getLoad())
+            stream.writeUint8(entry.getLoad());
+        for (size_t j = 0; j < neighborCount; j++) {
+            stream.writeUint32Be(entry.getNeighbors(j));
+            if (costs)
+                stream.writeUint16Be(entry.getLinkCosts(j));
+        }
+        if (entry.getDelta()) {
+            stream.writeUint32Be(entry.getBaseSequenceNumber());
+            size_t removedCount = entry.getRemovedNeighborsArraySize();
+            stream.writeUint16Be(removedCount);
+            for (size_t j = 0; j < removedCount; j++)
+                stream.writeUint32Be(entry.getRemovedNeighbors(j));
+        }
+    }
+
+    if (packet.getPacketType() == HELLO_TYPE) {
+        stream.writeUint16Be(packet.getHoldTime());
+        size_t mprCount = packet.getMprsArraySize();
+        stream.writeUint16Be(mprCount);
+        for (size_t i = 0; i < mprCount; i++)
+            stream.writeUint32Be(packet.getMprs(i));
+        size_t reportCount = packet.getReportedNeighborsArraySize();
+        stream.writeUint16Be(reportCount);
+        for (size_t i = 0; i < reportCount; i++) {
+            stream.writeUint32Be(packet.getReportedNeighbors(i));
+            stream.writeUint8(packet.getDeliveryRatios(i));
+        }
+    }
+}
+
+template<typename Packet, typename Stream>
+bool FsrWireCodec::read(Stream &stream, Packet &packet)
+{
+    bool correct = true;
+    packet.setPacketType(stream.readUint8());
+    packet.setSourceAddress(stream.readUint32Be());
+    packet.setSequenceNumber(stream.readUint32Be());
+
+    size_t entryCount = stream.readUint16Be();
+    // Every entry needs at least its fixed header, reject counts the remaining bytes cannot hold
+    if (ENTRY_HEADER_LENGTH * entryCount > stream.getRemainingBytes()) {
+        correct = false;
+        entryCount = 0;
+    }
+    packet.setLspEntriesArraySize(entryCount);
+    for (size_t i = 0; i < entryCount && !stream.isReadBeyondEnd(); i++) {
+        auto &entry = packet.getLspEntriesForUpdate(i);
+        entry.setNodeAddress(stream.readUint32Be());
+        entry.setSequenceNumber(stream.readUint32Be());
+        size_t neighborCount = stream.readUint16Be();
+        bool delta = (neighborCount & DELTA_FLAG) != 0;
+        bool costs = (neighborCount & COST_FLAG) != 0;
+        entry.setLoad((neighborCount & LOAD_FLAG) ? stream.readUint8() : 0);
+        neighborCount &= COUNT_MASK;
+        if ((costs ? 6 : 4) * neighborCount > stream.getRemainingBytes()) {
+            correct = false;
+            break;
+        }
+        entry.setNeighborsArraySize(neighborCount);
+        entry.setLinkCostsArraySize(costs ? neighborCount : 0);
+        for (size_t j = 0; j < neighborCount; j++) {
+            entry.setNeighbors(j, stream.readUint32Be());
+            if (costs)
+                entry.setLinkCosts(j, stream.readUint16Be());
+        }
+        entry.setDelta(delta);
+        entry.setBaseSequenceNumber(delta ? stream.readUint32Be() : 0);
+        size_t removedCount = delta ? stream.readUint16Be() : 0;
+        if (4 * removedCount > stream.getRemainingBytes()) {
+            correct = false;
+            break;
+        }
+        entry.setRemovedNeighborsArraySize(removedCount);
+        for (size_t j = 0; j < removedCount; j++)
+            entry.setRemovedNeighbors(j, stream.readUint32Be());
+    }
+
+    packet.setHoldTime(0);
+    packet.setMprsArraySize(0);
+    packet.setReportedNeighborsArraySize(0);
+    packet.setDeliveryRatiosArraySize(0);
+    if (packet.getPacketType() == HELLO_TYPE && correct) {
+        packet.setHoldTime(stream.readUint16Be());
+        size_t mprCount = stream.readUint16Be();
+        if (4 * mprCount > stream.getRemainingBytes()) {
+            correct = false;
+            mprCount = 0;
+        }
+        packet.setMprsArraySize(mprCount);
+        for (size_t i = 0; i < mprCount; i++)
+            packet.setMprs(i, stream.readUint32Be());
+        size_t reportCount = stream.readUint16Be();
+        if (DELIVERY_REPORT_LENGTH * reportCount > stream.getRemainingBytes()) {
+            correct = false;
+            reportCount = 0;
+        }
+        packet.setReportedNeighborsArraySize(reportCount);
+        packet.setDeliveryRatiosArraySize(reportCount);
+        for (size_t i = 0; i < reportCount; i++) {
+            packet.setReportedNeighbors(i, stream.readUint32Be());
+            packet.setDeliveryRatios(i, stream.readUint8());
+        }
+    }
+    return correct && !stream.isReadBeyondEnd();
+}
+
+} // namespace fsr
+} // namespace inet
+
+#endif /* INET_ROUTING_FSR_CORE_FSRWIRE_H_ */
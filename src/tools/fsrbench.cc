@@ -0,0 +1,443 @@
+/*
+ * fsrbench.cc
+ * Microbenchmark of the simulator-independent FSR core
+ *
+ * Build: make fsrbench
+ * Usage: fsrbench [-n 100,1000,10000] [-g grid,rgg,ba] [-m hop,etx,load] [-t seconds] [-v]
+ *
+ * With -v the incremental SPF is checked against full runs instead of
+ * timed; the exit status is 1 on the first mismatch.
+ */
+
+#include "inet/routing/fsr/core/FsrLinkState.h"
+#include "inet/routing/fsr/core/FsrWire.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace inet::fsr;
+
+// Every heap allocation of the process is counted, the benchmarks report the delta per operation
+static uint64_t numAllocations = 0;
+
+void *operator new(size_t size)
+{
+    numAllocations++;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+typedef std::vector<std::vector<uint32_t>> Graph; // adjacency by node index
+
+static uint32_t addressOf(uint32_t index)
+{
+    return 0x0A000001 + index; // 10.0.0.1 onwards
+}
+
+static void addLink(Graph& graph, uint32_t u, uint32_t v)
+{
+    graph[u].push_back(v);
+    graph[v].push_back(u);
+}
+
+static Graph makeGrid(uint32_t n, std::mt19937&)
+{
+    uint32_t side = (uint32_t)std::ceil(std::sqrt((double)n));
+    Graph graph(n);
+    for (uint32_t i = 0; i < n; i++) {
+        if ((i + 1) % side != 0 && i + 1 < n)
+            addLink(graph, i, i + 1);
+        if (i + side < n)
+            addLink(graph, i, i + side);
+    }
+    return graph;
+}
+
+// Random geometric graph in the unit square with an expected degree of about 8
+static Graph makeRandomGeometric(uint32_t n, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<double> x(n), y(n);
+    for (uint32_t i = 0; i < n; i++) {
+        x[i] = uniform(rng);
+        y[i] = uniform(rng);
+    }
+    double radius = std::sqrt(8.0 / (M_PI * n));
+    int cells = std::max(1, (int)(1 / radius));
+    std::vector<std::vector<uint32_t>> buckets(cells * cells);
+    auto cellOf = [&](double v) { return std::min(cells - 1, (int)(v * cells)); };
+    for (uint32_t i = 0; i < n; i++)
+        buckets[cellOf(y[i]) * cells + cellOf(x[i])].push_back(i);
+
+    Graph graph(n);
+    for (uint32_t i = 0; i < n; i++) {
+        int cx = cellOf(x[i]), cy = cellOf(y[i]);
+        for (int gy = std::max(0, cy - 1); gy <= std::min(cells - 1, cy + 1); gy++) {
+            for (int gx = std::max(0, cx - 1); gx <= std::min(cells - 1, cx + 1); gx++) {
+                for (uint32_t j : buckets[gy * cells + gx]) {
+                    double dx = x[i] - x[j], dy = y[i] - y[j];
+                    if (j > i && dx * dx + dy * dy <= radius * radius)
+                        addLink(graph, i, j);
+                }
+            }
+        }
+    }
+    return graph;
+}
+
+// Barabasi-Albert preferential attachment, two links per new node
+static Graph makeScaleFree(uint32_t n, std::mt19937& rng)
+{
+    Graph graph(n);
+    std::vector<uint32_t> endpoints; // each node once per incident link
+    for (uint32_t i = 1; i < std::min(n, 3u); i++) {
+        addLink(graph, i - 1, i);
+        endpoints.push_back(i - 1);
+        endpoints.push_back(i);
+    }
+    for (uint32_t i = 3; i < n; i++) {
+        uint32_t first = endpoints[rng() % endpoints.size()];
+        uint32_t second = first;
+        while (second == first)
+            second = endpoints[rng() % endpoints.size()];
+        for (uint32_t target : { first, second }) {
+            addLink(graph, i, target);
+            endpoints.push_back(i);
+            endpoints.push_back(target);
+        }
+    }
+    return graph;
+}
+
+// Fixed pseudo-random ETX cost of a link, the same in both directions, 1.00 to 4.00
+static FsrTopologyTable::LinkCost linkCost(uint32_t u, uint32_t v)
+{
+    uint32_t h = std::min(u, v) * 2654435761u ^ std::max(u, v) * 40503u;
+    return FsrTopologyTable::UNIT_COST + (h >> 8) % (3 * FsrTopologyTable::UNIT_COST + 1);
+}
+
+// Fixed pseudo-random load of a node for the load metric: a quarter each idle, 1/3, 2/3 and saturated
+static uint8_t nodeLoad(uint32_t index)
+{
+    return (index * 2654435761u >> 16) % 4 * 85;
+}
+
+// How a metric name sets up the link state: "hop", "etx" (advertised link costs) or "load" (hop count plus load penalties)
+struct Metric
+{
+    bool costs;
+    bool loads;
+
+    explicit Metric(const char *name) : costs(!strcmp(name, "etx")), loads(!strcmp(name, "load")) {}
+    bool isWeighted() const { return costs || loads; }
+    uint32_t getLoadPenalty() const { return loads ? 2 * FsrTopologyTable::UNIT_COST : 0; }
+};
+
+static FsrWireEntry makeEntry(const Graph& graph, uint32_t index, uint32_t seq, const Metric& metric)
+{
+    FsrWireEntry entry;
+    entry.nodeAddress = addressOf(index);
+    entry.sequenceNumber = seq;
+    for (uint32_t neighbor : graph[index]) {
+        entry.neighbors.push_back(addressOf(neighbor));
+        if (metric.costs)
+            entry.linkCosts.push_back(linkCost(index, neighbor));
+    }
+    if (metric.loads)
+        entry.load = nodeLoad(index);
+    return entry;
+}
+
+// Stores a new version of node end's entry, without its link to other unless that is UINT32_MAX
+static void advertise(FsrLinkState& linkState, const Graph& graph, const std::vector<uint32_t>& ids, const Metric& metric,
+        uint32_t end, uint32_t other, uint32_t seq, std::vector<uint32_t>& neighborIds, std::vector<FsrTopologyTable::LinkCost>& costs)
+{
+    neighborIds.clear();
+    costs.clear();
+    for (uint32_t neighbor : graph[end]) {
+        if (neighbor != other) {
+            neighborIds.push_back(ids[neighbor]);
+            costs.push_back(linkCost(end, neighbor));
+        }
+    }
+    linkState.setEntry(ids[end], seq, neighborIds, seq, metric.costs ? &costs : nullptr);
+}
+
+// Compares the last result of linkState with a full run over a copy of it. Distances must agree;
+// on ties the first hop and hop count may differ from the full run's, but must be those of a
+// shortest path: the one over some predecessor u that lies on a shortest path itself
+static bool checkShortestPaths(const FsrLinkState& linkState, uint32_t sourceId, const Metric& metric)
+{
+    FsrLinkState reference = linkState;
+    reference.setTrackChanges(false);
+    std::vector<uint32_t> changed;
+    reference.computeShortestPaths(sourceId, changed);
+    const FsrTopologyTable& table = linkState.getTable();
+    const FsrSpf& spf = linkState.getSpf();
+    // Entries may disagree about a link while one end is not yet re-advertised, so links are taken from their origin
+    std::vector<std::vector<uint32_t>> predecessors(table.getNumIds());
+    for (uint32_t u = 0; u < table.getNumIds(); u++) {
+        if (table.hasEntry(u)) {
+            for (uint32_t v : table.getNeighbors(u))
+                predecessors[v].push_back(u);
+        }
+    }
+    for (uint32_t v = 0; v < table.getNumIds(); v++) {
+        if (spf.getDistance(v) != reference.getSpf().getDistance(v)) {
+            fprintf(stderr, "node %u: distance %u, full run %u\n", v, spf.getDistance(v), reference.getSpf().getDistance(v));
+            return false;
+        }
+        if (v == sourceId || !spf.isReachable(v))
+            continue;
+        bool onShortestPath = false;
+        for (uint32_t u : predecessors[v]) {
+            uint32_t cost = table.getLinkCost(u, v);
+            if (!spf.isReachable(u))
+                continue;
+            uint32_t transit = u == sourceId ? 0 : metric.getLoadPenalty() * table.getLoad(u) / 255;
+            uint32_t firstHop = u == sourceId ? v : spf.getNextHop(u);
+            if (spf.getDistance(u) + transit + cost == spf.getDistance(v) && firstHop == spf.getNextHop(v)
+                    && spf.getHopCount(u) + 1 == spf.getHopCount(v))
+                onShortestPath = true;
+        }
+        if (!onShortestPath) {
+            fprintf(stderr, "node %u: first hop %u with %u hops is not on a shortest path\n", v, spf.getNextHop(v), spf.getHopCount(v));
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Result
+{
+    uint64_t ops = 0;
+    double seconds = 0;
+    uint64_t allocations = 0;
+};
+
+// Repeats body (which performs opsPerCall operations) until at least minSeconds have passed
+template<typename Body>
+static Result measure(double minSeconds, uint64_t opsPerCall, Body body)
+{
+    typedef std::chrono::steady_clock Clock;
+    Result result;
+    uint64_t allocationsBefore = numAllocations;
+    Clock::time_point start = Clock::now();
+    do {
+        body();
+        result.ops += opsPerCall;
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (result.seconds < minSeconds);
+    result.allocations = numAllocations - allocationsBefore;
+    return result;
+}
+
+static void report(const char *topology, uint32_t n, const char *metric, const char *benchmark, const Result& result)
+{
+    printf("%-6s %6u %-4s %-10s %12.0f %12.1f %10.2f\n", topology, n, metric, benchmark,
+            result.ops / result.seconds, result.seconds * 1e9 / result.ops, (double)result.allocations / result.ops);
+}
+
+static void runBenchmarks(const char *topology, const Graph& graph, const char *metricName, double minSeconds, std::mt19937& rng)
+{
+    uint32_t n = (uint32_t)graph.size();
+    Metric metric(metricName);
+
+    // Codec: full-state LSP packets of up to 32 entries, encoded and decoded again
+    std::vector<FsrWirePacket> packets;
+    for (uint32_t i = 0; i < n; i++) {
+        if (i % 32 == 0) {
+            packets.emplace_back();
+            packets.back().packetType = 2;
+            packets.back().sourceAddress = addressOf(i);
+        }
+        packets.back().lspEntries.push_back(makeEntry(graph, i, 1, metric));
+    }
+    std::vector<uint8_t> bytes;
+    FsrWirePacket decoded;
+    report(topology, n, metricName, "codec", measure(minSeconds, n, [&]() {
+        for (const auto& packet : packets) {
+            bytes.clear();
+            FsrWireCodec::encode(packet, bytes);
+            if (!FsrWireCodec::decode(bytes.data(), bytes.size(), decoded))
+                abort();
+        }
+    }));
+
+    // Apply: every node's entry in a new version, replacing the stored one in place
+    std::vector<FsrWireEntry> entries;
+    for (uint32_t i = 0; i < n; i++)
+        entries.push_back(makeEntry(graph, i, 0, metric));
+    FsrLinkState linkState;
+    linkState.setWeighted(metric.isWeighted());
+    linkState.setLoadPenalty(metric.getLoadPenalty());
+    linkState.setTrackChanges(true);
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < n; i++)
+        ids.push_back(linkState.intern(addressOf(i)));
+    uint32_t seq = 0;
+    report(topology, n, metricName, "apply", measure(minSeconds, n, [&]() {
+        seq++;
+        for (uint32_t i = 0; i < n; i++) {
+            entries[i].sequenceNumber = seq;
+            if (linkState.applyEntry(ids[i], entries[i], seq) != FsrLinkState::APPLY_ACCEPTED)
+                abort();
+        }
+    }));
+
+    // Full SPF from node 0
+    std::vector<uint32_t> changed;
+    linkState.setTrackChanges(false);
+    report(topology, n, metricName, "spf-full", measure(minSeconds, 1, [&]() {
+        linkState.computeShortestPaths(ids[0], changed);
+    }));
+
+    // Incremental SPF: one node alternately loses and regains a link, both ends advertise it
+    linkState.setTrackChanges(true);
+    linkState.computeShortestPaths(ids[0], changed);
+    std::vector<uint32_t> neighborIds;
+    std::vector<FsrTopologyTable::LinkCost> costs;
+    report(topology, n, metricName, "spf-incr", measure(minSeconds, 1, [&]() {
+        uint32_t u = rng() % n;
+        if (graph[u].empty())
+            return;
+        uint32_t v = graph[u][rng() % graph[u].size()];
+        seq++;
+        advertise(linkState, graph, ids, metric, u, v, seq, neighborIds, costs);
+        advertise(linkState, graph, ids, metric, v, u, seq, neighborIds, costs);
+        linkState.computeShortestPaths(ids[0], changed);
+        seq++;
+        advertise(linkState, graph, ids, metric, u, UINT32_MAX, seq, neighborIds, costs);
+        advertise(linkState, graph, ids, metric, v, UINT32_MAX, seq, neighborIds, costs);
+        linkState.computeShortestPaths(ids[0], changed);
+    }));
+}
+
+// Runs the steps of the spf-incr benchmark, with load metric also load changes, and checks every
+// incremental result against a full run
+static bool verifyIncremental(const char *topology, const Graph& graph, const char *metricName, uint32_t numSteps, std::mt19937& rng)
+{
+    uint32_t n = (uint32_t)graph.size();
+    Metric metric(metricName);
+    FsrLinkState linkState;
+    linkState.setWeighted(metric.isWeighted());
+    linkState.setLoadPenalty(metric.getLoadPenalty());
+    linkState.setTrackChanges(true);
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < n; i++)
+        ids.push_back(linkState.intern(addressOf(i)));
+    for (uint32_t i = 0; i < n; i++)
+        linkState.applyEntry(ids[i], makeEntry(graph, i, 1, metric), 0);
+
+    std::vector<uint32_t> changed, neighborIds;
+    std::vector<FsrTopologyTable::LinkCost> costs;
+    linkState.computeShortestPaths(ids[0], changed);
+    uint32_t seq = 1, numIncremental = 0;
+    for (uint32_t step = 0; step < numSteps; step++) {
+        uint32_t u = rng() % n;
+        if (graph[u].empty())
+            continue;
+        uint32_t v = graph[u][rng() % graph[u].size()];
+        bool down = step % 2 == 0;
+        seq++;
+        advertise(linkState, graph, ids, metric, u, down ? v : UINT32_MAX, seq, neighborIds, costs);
+        advertise(linkState, graph, ids, metric, v, down ? u : UINT32_MAX, seq, neighborIds, costs);
+        if (metric.loads) {
+            uint32_t loaded = rng() % n;
+            linkState.setLoad(ids[loaded], rng() % 4 * 85);
+        }
+        numIncremental += linkState.computeShortestPaths(ids[0], changed);
+        if (!checkShortestPaths(linkState, ids[0], metric)) {
+            fprintf(stderr, "%s %u %s: incremental SPF differs from a full run after step %u\n", topology, n, metricName, step);
+            return false;
+        }
+    }
+    printf("%-6s %6u %-4s %-10s %u steps, %u incremental, all match full runs\n", topology, n, metricName, "verify", numSteps, numIncremental);
+    return true;
+}
+
+static std::vector<std::string> split(const char *list)
+{
+    std::vector<std::string> items;
+    std::string item;
+    for (const char *p = list; ; p++) {
+        if (*p == ',' || *p == '\0') {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+            if (*p == '\0')
+                break;
+        }
+        else
+            item += *p;
+    }
+    return items;
+}
+
+int main(int argc, char **argv)
+{
+    const char *sizes = "100,1000,10000";
+    const char *topologies = "grid,rgg,ba";
+    const char *metrics = "hop";
+    double minSeconds = 0.2;
+    bool verify = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            sizes = argv[++i];
+        else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+            topologies = argv[++i];
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            metrics = argv[++i];
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            minSeconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-v"))
+            verify = true;
+        else {
+            fprintf(stderr, "usage: %s [-n 100,1000,10000] [-g grid,rgg,ba] [-m hop,etx,load] [-t seconds] [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!verify)
+        printf("%-6s %6s %-4s %-10s %12s %12s %10s\n", "topo", "nodes", "metr", "benchmark", "ops/s", "ns/op", "allocs/op");
+    for (const std::string& topology : split(topologies)) {
+        for (const std::string& size : split(sizes)) {
+            uint32_t n = (uint32_t)atoi(size.c_str());
+            std::mt19937 rng(n);
+            Graph graph;
+            if (topology == "grid")
+                graph = makeGrid(n, rng);
+            else if (topology == "rgg")
+                graph = makeRandomGeometric(n, rng);
+            else if (topology == "ba")
+                graph = makeScaleFree(n, rng);
+            else {
+                fprintf(stderr, "unknown topology '%s'\n", topology.c_str());
+                return 1;
+            }
+            for (const std::string& metric : split(metrics)) {
+                if (metric != "hop" && metric != "etx" && metric != "load") {
+                    fprintf(stderr, "unknown metric '%s'\n", metric.c_str());
+                    return 1;
+                }
+                if (!verify)
+                    runBenchmarks(topology.c_str(), graph, metric.c_str(), minSeconds, rng);
+                else if (!verifyIncremental(topology.c_str(), graph, metric.c_str(), 400, rng))
+                    return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * fsrcheck.cc
+ * Consistency checks of the simulator-independent FSR core
+ *
+ * Build and run: make check
+ */
+
+#include "inet/routing/fsr/core/FsrLinkState.h"
+#include "inet/routing/fsr/core/FsrWire.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace inet::fsr;
+
+static int numFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            numFailures++; \
+        } \
+    } while (0)
+
+static const uint32_t NODE_A = 0x0A000001;
+
+static FsrWireEntry makeFullEntry(uint32_t address, uint32_t seq, const std::vector<uint32_t>& neighbors)
+{
+    FsrWireEntry entry;
+    entry.nodeAddress = address;
+    entry.sequenceNumber = seq;
+    entry.neighbors = neighbors;
+    return entry;
+}
+
+// A stored foreign entry as Fsr::fillLspEntry relays it: an empty delta from the stable seq, else in full
+static FsrWireEntry relayEntry(const FsrLinkState& linkState, uint32_t id)
+{
+    const FsrTopologyTable& table = linkState.getTable();
+    FsrWireEntry entry;
+    entry.nodeAddress = table.getAddress(id);
+    entry.sequenceNumber = table.getSeq(id);
+    entry.load = table.getLoad(id);
+    if (table.getStableSeq(id) < table.getSeq(id)) {
+        entry.delta = true;
+        entry.baseSequenceNumber = table.getStableSeq(id);
+    }
+    else {
+        for (uint32_t neighbor : table.getNeighbors(id))
+            entry.neighbors.push_back(table.getAddress(neighbor));
+    }
+    return entry;
+}
+
+static std::vector<uint32_t> storedNeighbors(const FsrLinkState& linkState, uint32_t id)
+{
+    std::vector<uint32_t> neighbors;
+    for (uint32_t neighbor : linkState.getTable().getNeighbors(id))
+        neighbors.push_back(linkState.getTable().getAddress(neighbor));
+    return neighbors;
+}
+
+// A relay that missed a version must not relay an empty delta spanning it
+static void checkMissedVersion()
+{
+    const std::vector<uint32_t> l1 = { 0x0A000002, 0x0A000003 };
+    const std::vector<uint32_t> l2 = { 0x0A000002, 0x0A000004 };
+
+    FsrLinkState relay, receiver;
+    uint32_t relayId = relay.intern(NODE_A);
+    uint32_t receiverId = receiver.intern(NODE_A);
+
+    // The relay hears A@5 with L1, misses A@6 with L2 and hears A@7 with L1 again
+    CHECK(relay.applyEntry(relayId, makeFullEntry(NODE_A, 5, l1), 0) == FsrLinkState::APPLY_ACCEPTED);
+    CHECK(relay.applyEntry(relayId, makeFullEntry(NODE_A, 7, l1), 1) == FsrLinkState::APPLY_ACCEPTED);
+    CHECK(relay.getTable().getStableSeq(relayId) == 7);
+
+    // The receiver holds A@6 with L2; whatever the relay sends must not leave L2 under seq 7
+    CHECK(receiver.applyEntry(receiverId, makeFullEntry(NODE_A, 6, l2), 0) == FsrLinkState::APPLY_ACCEPTED);
+    FsrLinkState::ApplyResult result = receiver.applyEntry(receiverId, relayEntry(relay, relayId), 1);
+    CHECK(result == FsrLinkState::APPLY_ACCEPTED);
+    CHECK(receiver.getTable().getSeq(receiverId) == 7);
+    CHECK(storedNeighbors(receiver, receiverId) == l1);
+}
+
+// Consecutive versions keep the stable seq, and an empty delta over missed versions vouches for them
+static void checkStableSeq()
+{
+    const std::vector<uint32_t> l1 = { 0x0A000002, 0x0A000003 };
+
+    FsrLinkState relay;
+    uint32_t id = relay.intern(NODE_A);
+    CHECK(relay.applyEntry(id, makeFullEntry(NODE_A, 5, l1), 0) == FsrLinkState::APPLY_ACCEPTED);
+    CHECK(relay.applyEntry(id, makeFullEntry(NODE_A, 6, l1), 1) == FsrLinkState::APPLY_ACCEPTED);
+    CHECK(relay.getTable().getStableSeq(id) == 5);
+
+    FsrWireEntry emptyDelta = makeFullEntry(NODE_A, 9, {});
+    emptyDelta.delta = true;
+    emptyDelta.baseSequenceNumber = 6;
+    CHECK(relay.applyEntry(id, emptyDelta, 2) == FsrLinkState::APPLY_ACCEPTED);
+    CHECK(relay.getTable().getStableSeq(id) == 5);
+    CHECK(storedNeighbors(relay, id) == l1);
+
+    // A changed list over missed versions starts a new stable range either way
+    CHECK(relay.applyEntry(id, makeFullEntry(NODE_A, 11, { 0x0A000002 }), 3) == FsrLinkState::APPLY_ACCEPTED);
+    CHECK(relay.getTable().getStableSeq(id) == 11);
+}
+
+// Random packets survive encode and decode unchanged, and every truncation is detected
+static void checkCodecRoundTrip()
+{
+    std::mt19937 rng(1);
+    for (int t = 0; t < 500; t++) {
+        FsrWirePacket packet;
+        packet.packetType = 1 + rng() % 3;
+        packet.sourceAddress = rng();
+        packet.sequenceNumber = rng();
+        packet.lspEntries.resize(rng() % 4);
+        for (FsrWireEntry& entry : packet.lspEntries) {
+            entry.nodeAddress = rng();
+            entry.sequenceNumber = rng();
+            entry.neighbors.resize(rng() % 6);
+            for (uint32_t& neighbor : entry.neighbors)
+                neighbor = rng();
+            if (rng() % 2) {
+                for (size_t j = 0; j < entry.neighbors.size(); j++)
+                    entry.linkCosts.push_back(rng());
+            }
+            if (rng() % 2) {
+                entry.delta = true;
+                entry.baseSequenceNumber = rng();
+                entry.removedNeighbors.resize(rng() % 3);
+                for (uint32_t& neighbor : entry.removedNeighbors)
+                    neighbor = rng();
+            }
+            entry.load = rng() % 2 ? rng() : 0;
+        }
+        if (packet.packetType == FsrWireCodec::HELLO_TYPE) {
+            packet.holdTime = rng();
+            packet.mprs.resize(rng() % 3);
+            for (uint32_t& mpr : packet.mprs)
+                mpr = rng();
+            packet.reportedNeighbors.resize(rng() % 3);
+            for (uint32_t& neighbor : packet.reportedNeighbors) {
+                neighbor = rng();
+                packet.deliveryRatios.push_back(rng());
+            }
+        }
+
+        std::vector<uint8_t> bytes, again;
+        FsrWireCodec::encode(packet, bytes);
+        CHECK(bytes.size() == FsrWireCodec::getLength(packet));
+        FsrWirePacket decoded;
+        size_t consumed = 0;
+        CHECK(FsrWireCodec::decode(bytes.data(), bytes.size(), decoded, &consumed));
+        CHECK(consumed == bytes.size());
+        FsrWireCodec::encode(decoded, again);
+        CHECK(again == bytes);
+        CHECK(!FsrWireCodec::decode(bytes.data(), bytes.size() - 1, decoded));
+    }
+}
+
+// Lists longer than their count field are refused instead of being truncated
+static void checkCountLimits()
+{
+    FsrWirePacket packet;
+    packet.packetType = 2;
+    packet.lspEntries.resize(1);
+    packet.lspEntries[0].neighbors.resize(FsrWireCodec::COUNT_MASK);
+    std::vector<uint8_t> bytes;
+    FsrWireCodec::encode(packet, bytes);
+    CHECK(bytes.size() == FsrWireCodec::getLength(packet));
+
+    packet.lspEntries[0].neighbors.resize(FsrWireCodec::COUNT_MASK + 1);
+    bool thrown = false;
+    try {
+        FsrWireCodec::encode(packet, bytes);
+    }
+    catch (const std::length_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+int main()
+{
+    checkMissedVersion();
+    checkStableSeq();
+    checkCodecRoundTrip();
+    checkCountLimits();
+    if (numFailures) {
+        fprintf(stderr, "%d check(s) failed\n", numFailures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
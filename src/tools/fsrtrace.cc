@@ -0,0 +1,84 @@
+/*
+ * fsrtrace.cc
+ * Offline decoder for FSR binary trace files
+ *
+ * Build: g++ -O2 -o fsrtrace fsrtrace.cc
+ * Usage: fsrtrace <file.fsrtrace>...
+ */
+
+#include "../routing/FsrTrace.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+using namespace inet::fsr;
+
+static const char *addr(uint32_t a, char *buf)
+{
+    snprintf(buf, 16, "%u.%u.%u.%u", (a >> 24) & 0xFF, (a >> 16) & 0xFF, (a >> 8) & 0xFF, a & 0xFF);
+    return buf;
+}
+
+static const char *packetType(uint32_t type)
+{
+    return type == 1 ? "HELLO" : type == 2 ? "LSP" : type == 3 ? "LSP_REQUEST" : "?";
+}
+
+static void printRecord(const char *node, const FsrTraceRecord& r)
+{
+    char a1[16], a2[16];
+    printf("%.6f %s ", r.time, node);
+    switch (r.event) {
+        case FSR_EV_PACKET_RECEIVED: printf("rx from=%s type=%s len=%u\n", addr(r.a, a1), packetType(r.b), r.c); break;
+        case FSR_EV_PACKET_SENT: printf("tx to=%s type=%s len=%u\n", addr(r.a, a1), packetType(r.b), r.c); break;
+        case FSR_EV_HELLO_RECEIVED: printf("hello from=%s seq=%u neighbors=%u\n", addr(r.a, a1), r.b, r.c); break;
+        case FSR_EV_LSP_ENTRY_ACCEPTED: printf("lsp-accept origin=%s seq=%u neighbors=%u\n", addr(r.a, a1), r.b, r.c); break;
+        case FSR_EV_LSP_ENTRY_STALE: printf("lsp-stale origin=%s seq=%u stored=%u\n", addr(r.a, a1), r.b, r.c); break;
+        case FSR_EV_LSP_RELAYED: printf("relay source=%s seq=%u hops=%u\n", addr(r.a, a1), r.b, r.c); break;
+        case FSR_EV_NEIGHBOR_ADDED: printf("neighbor-add %s count=%u\n", addr(r.a, a1), r.b); break;
+        case FSR_EV_NEIGHBOR_REMOVED: printf("neighbor-remove %s count=%u\n", addr(r.a, a1), r.b); break;
+        case FSR_EV_SPF_RUN: printf("spf ids=%u entries=%u recomputed=%u\n", r.a, r.b, r.c); break;
+        case FSR_EV_ROUTES_UPDATED: printf("routes added=%u changed=%u deleted=%u\n", r.a, r.b, r.c); break;
+        case FSR_EV_SCOPE_UPDATE_SENT: printf("scope-update scope=%u entries=%u\n", r.a, r.b); break;
+        case FSR_EV_MALFORMED_PACKET: printf("malformed from=%s len=%u\n", addr(r.a, a2), r.b); break;
+        case FSR_EV_LSP_ENTRY_EXPIRED: printf("lsp-expired origin=%s seq=%u\n", addr(r.a, a1), r.b); break;
+        case FSR_EV_LSP_DELTA_GAP: printf("lsp-gap origin=%s seq=%u base=%u\n", addr(r.a, a1), r.b, r.c); break;
+        default: printf("event=%u a=%u b=%u c=%u\n", r.event, r.a, r.b, r.c); break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file.fsrtrace>...\n", argv[0]);
+        return 1;
+    }
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+        FsrTraceFileHeader header;
+        if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, "FSRT", 4) != 0
+                || header.version != 1 || header.recordSize != sizeof(FsrTraceRecord)) {
+            fprintf(stderr, "%s: not an FSR trace file\n", argv[i]);
+            fclose(f);
+            status = 1;
+            continue;
+        }
+        char node[33], a1[16];
+        memcpy(node, header.nodeName, 32);
+        node[32] = '\0';
+        printf("# %s node=%s addr=%s records=%u total=%" PRIu64 "\n", argv[i], node,
+                addr(header.nodeAddress, a1), header.numRecords, header.totalRecorded);
+        FsrTraceRecord r;
+        for (uint32_t n = 0; n < header.numRecords && fread(&r, sizeof(r), 1, f) == 1; n++)
+            printRecord(node, r);
+        fclose(f);
+    }
+    return status;
+}